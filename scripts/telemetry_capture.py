@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""
+Telemetry capture tool for BMCU370 firmware
+
+Records the TELEMETRY frames (see src/Telemetry.h) from the debug UART and
+writes one CSV row per sample with the buffer and presence voltages, AS5600
+angle, speed and commanded PWM of every channel, in engineering units.
+Other trace events and text log output are ignored.
+
+The firmware must be built with DEBUG_TRACE_ENABLED and a non-zero
+TELEMETRY_RATE_HZ.
+
+Examples:
+    python3 scripts/telemetry_capture.py --port /dev/ttyUSB0 --duration 30 -o run1.csv
+    python3 scripts/telemetry_capture.py capture.bin -o run1.csv
+"""
+
+import argparse
+import sys
+import time
+
+from trace_decode import DEFAULT_TABLE, FrameDecoder, load_event_table
+
+CHANNELS = 4
+FIELDS = [
+    # column, frame field, scale
+    ('pull_v', 'pull_mv', 0.001),
+    ('online_v', 'online_mv', 0.001),
+    ('angle', 'angle', 1),
+    ('speed_mm_s', 'speed', 0.01),
+    ('pwm', 'pwm', 1),
+]
+
+
+def header():
+    columns = ['t_us']
+    for ch in range(CHANNELS):
+        columns += [f'{name}{ch}' for name, _, _ in FIELDS]
+    return ','.join(columns)
+
+
+def row(t_us, args):
+    values = [str(t_us)]
+    for ch in range(CHANNELS):
+        for _, field, scale in FIELDS:
+            value = args[f'{field}{ch}']
+            values.append(f'{value * scale:.3f}' if scale != 1 else str(value))
+    return ','.join(values)
+
+
+def chunks(args):
+    if args.port:
+        try:
+            import serial
+        except ImportError:
+            sys.exit('pyserial is required for --port (pip install pyserial)')
+        port = serial.Serial(args.port, args.baud, parity=serial.PARITY_EVEN, timeout=0.1)
+        end = time.monotonic() + args.duration if args.duration else None
+        try:
+            while end is None or time.monotonic() < end:
+                yield port.read(8192)
+        except KeyboardInterrupt:
+            return
+    else:
+        with open(args.input, 'rb') as f:
+            while True:
+                chunk = f.read(65536)
+                if not chunk:
+                    return
+                yield chunk
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Capture BMCU370 sensor telemetry to CSV')
+    parser.add_argument('input', nargs='?', help='raw capture file of the debug UART')
+    parser.add_argument('--port', help='read live from a serial port (Ctrl+C to stop)')
+    parser.add_argument('--baud', type=int, default=1000000, help='serial baud rate (DEBUG_TRACE_BAUDRATE)')
+    parser.add_argument('--duration', type=float, help='stop after this many seconds (with --port)')
+    parser.add_argument('--table', default=str(DEFAULT_TABLE), help='path to Trace.h')
+    parser.add_argument('-o', '--output', help='output CSV file (default stdout)')
+    args = parser.parse_args()
+    if not args.input and not args.port:
+        parser.error('give a capture file or --port')
+
+    decoder = FrameDecoder(load_event_table(args.table))
+    out = open(args.output, 'w', encoding='utf-8') if args.output else sys.stdout
+    samples = 0
+    first = last = None
+    try:
+        out.write(header() + '\n')
+        for chunk in chunks(args):
+            for t_us, name, frame in decoder.feed(chunk):
+                if name != 'TELEMETRY':
+                    continue
+                out.write(row(t_us, frame) + '\n')
+                samples += 1
+                first = t_us if first is None else first
+                last = t_us
+    finally:
+        if args.output:
+            out.close()
+
+    rate = (samples - 1) / ((last - first) / 1e6) if samples > 1 and last > first else 0
+    print(f'{samples} samples, {rate:.1f} Hz average, {decoder.bad_frames} bad frames', file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
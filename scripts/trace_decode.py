@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+"""
+Binary trace decoder for BMCU370 firmware
+
+Reads the debug UART stream (a capture file or a live serial port), extracts
+the binary trace frames described in src/Trace.h and writes them as CSV or as
+Chrome trace JSON (open in https://ui.perfetto.dev or chrome://tracing).
+Plain text log output found between frames is passed through to stderr.
+
+The event table is parsed from src/Trace.h, so the firmware and the decoder
+always agree on names and argument formats.
+
+Examples:
+    python3 scripts/trace_decode.py --port /dev/ttyUSB0 --format chrome -o trace.json
+    python3 scripts/trace_decode.py capture.bin --format csv -o trace.csv
+"""
+
+import argparse
+import json
+import re
+import struct
+import sys
+from pathlib import Path
+
+SYNC = b'\xa5\x5a'
+HEADER_SIZE = 8  # sync(2) id(1) len(1) t_us(4)
+MAX_ARGS = 48
+
+DEFAULT_TABLE = Path(__file__).resolve().parent.parent / 'src' / 'Trace.h'
+
+
+def load_event_table(path):
+    """Parse TRACE_EVENT_TABLE entries: X(NAME, id, "fmt", "arg,names")"""
+    text = Path(path).read_text(encoding='utf-8').replace('\\\n', ' ')  # join macro lines
+    events = {}
+    literals = r'((?:"[^"]*"\s*)+)'  # adjacent string literals are concatenated
+    for name, event_id, fmt, names in re.findall(
+            r'X\((\w+),\s*(0x[0-9A-Fa-f]+|\d+),\s*' + literals + r',\s*' + literals + r'\)', text):
+        fmt, names = (''.join(re.findall(r'"([^"]*)"', x)) for x in (fmt, names))
+        arg_names = [n.strip() for n in names.split(',')] if names else []
+        if len(arg_names) != len(fmt):
+            raise ValueError(f'{name}: format "{fmt}" does not match names "{names}"')
+        events[int(event_id, 0)] = (name, '<' + fmt, arg_names)
+    if not events:
+        raise ValueError(f'no TRACE_EVENT_TABLE entries found in {path}')
+    return events
+
+
+class FrameDecoder:
+    """Incremental frame parser; feed() bytes, collect decoded events"""
+
+    def __init__(self, events, text_out=None):
+        self.events = events
+        self.text_out = text_out
+        self.buf = bytearray()
+        self.last_t = None
+        self.t_high = 0
+        self.bad_frames = 0
+
+    def _text(self, data):
+        if self.text_out and data:
+            self.text_out.write(data.decode('utf-8', errors='replace'))
+
+    def _timestamp(self, t32):
+        # Unwrap the 32-bit microsecond counter (wraps every ~71 minutes)
+        if self.last_t is not None and t32 < self.last_t and self.last_t - t32 > 0x80000000:
+            self.t_high += 1 << 32
+        self.last_t = t32
+        return self.t_high + t32
+
+    def feed(self, data):
+        self.buf += data
+        out = []
+        while True:
+            start = self.buf.find(SYNC)
+            if start < 0:
+                keep = 1 if self.buf.endswith(SYNC[:1]) else 0
+                self._text(bytes(self.buf[:len(self.buf) - keep]))
+                del self.buf[:len(self.buf) - keep]
+                break
+            self._text(bytes(self.buf[:start]))
+            del self.buf[:start]
+            if len(self.buf) < HEADER_SIZE:
+                break
+            event_id, length = self.buf[2], self.buf[3]
+            if length > MAX_ARGS or event_id not in self.events:
+                self._text(bytes(self.buf[:1]))
+                del self.buf[:1]
+                continue
+            size = HEADER_SIZE + length + 1
+            if len(self.buf) < size:
+                break
+            frame = bytes(self.buf[:size])
+            name, fmt, arg_names = self.events[event_id]
+            if sum(frame[2:]) & 0xFF or struct.calcsize(fmt) != length:
+                self.bad_frames += 1
+                self._text(frame[:1])
+                del self.buf[:1]
+                continue
+            del self.buf[:size]
+            t_us = self._timestamp(struct.unpack_from('<I', frame, 4)[0])
+            values = struct.unpack_from(fmt, frame, HEADER_SIZE)
+            out.append((t_us, name, dict(zip(arg_names, values))))
+        return out
+
+
+def write_csv(events, out):
+    out.write('t_us,event,args\n')
+    for t_us, name, args in events:
+        fields = ';'.join(f'{k}={v:.6g}' if isinstance(v, float) else f'{k}={v}' for k, v in args.items())
+        out.write(f'{t_us},{name},{fields}\n')
+
+
+def write_chrome(events, out):
+    """Events with a 'ch' argument go on one track per channel; numeric args also become counters"""
+    trace = []
+    for t_us, name, args in events:
+        tid = args.get('ch', 'sys')
+        trace.append({'name': name, 'ph': 'i', 's': 't', 'ts': t_us, 'pid': 0, 'tid': tid, 'args': args})
+        counters = {k: v for k, v in args.items() if k != 'ch'}
+        if counters:
+            label = f'{name} ch{tid}' if 'ch' in args else name
+            trace.append({'name': label, 'ph': 'C', 'ts': t_us, 'pid': 0, 'args': counters})
+    json.dump({'traceEvents': trace, 'displayTimeUnit': 'ms'}, out)
+
+
+def read_source(args):
+    if args.port:
+        try:
+            import serial
+        except ImportError:
+            sys.exit('pyserial is required for --port (pip install pyserial)')
+        # Debug UART is 8 data bits + even parity (USART_WordLength_9b with parity)
+        port = serial.Serial(args.port, args.baud, parity=serial.PARITY_EVEN, timeout=0.1)
+        try:
+            while True:
+                yield port.read(4096)
+        except KeyboardInterrupt:
+            return
+    else:
+        with open(args.input, 'rb') as f:
+            while True:
+                chunk = f.read(65536)
+                if not chunk:
+                    return
+                yield chunk
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode BMCU370 binary trace frames')
+    parser.add_argument('input', nargs='?', help='raw capture file of the debug UART')
+    parser.add_argument('--port', help='read live from a serial port instead of a file (Ctrl+C to stop)')
+    parser.add_argument('--baud', type=int, default=1000000, help='serial baud rate (DEBUG_TRACE_BAUDRATE)')
+    parser.add_argument('--format', choices=['csv', 'chrome'], default='csv')
+    parser.add_argument('--table', default=str(DEFAULT_TABLE), help='path to Trace.h')
+    parser.add_argument('-o', '--output', help='output file (default stdout)')
+    parser.add_argument('--quiet', action='store_true', help='do not echo text log output to stderr')
+    args = parser.parse_args()
+    if not args.input and not args.port:
+        parser.error('give a capture file or --port')
+
+    decoder = FrameDecoder(load_event_table(args.table), None if args.quiet else sys.stderr)
+    events = []
+    for chunk in read_source(args):
+        events += decoder.feed(chunk)
+
+    out = open(args.output, 'w', encoding='utf-8') if args.output else sys.stdout
+    try:
+        if args.format == 'csv':
+            write_csv(events, out)
+        else:
+            write_chrome(events, out)
+    finally:
+        if args.output:
+            out.close()
+    print(f'{len(events)} events, {decoder.bad_frames} bad frames', file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
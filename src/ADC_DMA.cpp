@@ -13,6 +13,8 @@ constexpr const int ADC_filter_n = mypow(2, ADC_filter_n_pow); // 滑动窗口
 // 说明：滑动滤波后信号的频率变为f/(2n),f约为8000,n=256,则滤波后变为15hz
 uint16_t ADC_data[ADC_filter_n][8];
 float ADC_V[8];
+uint32_t ADC_start_time = 0;
+bool ADC_filled = false;
 
 void ADC_DMA_init()
 {
@@ -79,7 +81,19 @@ void ADC_DMA_init()
         ADC_SoftwareStartConvCmd(ADC1, ENABLE);                                  // 开启ADC转换
     }
 
-    delay(ADC_filter_n); // 等待8次缓冲区域满(每ms可以转换8组数据)
+    // 缓冲区约ADC_filter_n ms后才填满(每ms可以转换8组数据), 不在这里等待, 用ADC_DMA_ready()判断
+    ADC_start_time = millis();
+}
+
+/**
+ * @return true once the filter window has been filled after ADC_DMA_init();
+ *         averages read before that are pulled towards 0
+ */
+bool ADC_DMA_ready()
+{
+    if (!ADC_filled && (millis() - ADC_start_time >= ADC_filter_n + 1))
+        ADC_filled = true;
+    return ADC_filled;
 }
 
 float *ADC_DMA_get_value()
@@ -2,4 +2,5 @@
 #include "main.h"
 
 extern void ADC_DMA_init();
-extern float *ADC_DMA_get_value();
\ No newline at end of file
+extern float *ADC_DMA_get_value();
+extern bool ADC_DMA_ready();
@@ -38,43 +38,318 @@ struct _filament
 };
 
 /**
- * Flash memory structure for persistent storage
- * Aligned to 4-byte boundary for flash memory efficiency
+ * Filament state of all channels
+ * Only part of it is persisted, see the TLV schema below
  */
-struct alignas(4) flash_save_struct
+struct bambubus_state_struct
 {
     _filament filament[MAX_FILAMENT_CHANNELS];  ///< Filament data for all channels
     int BambuBus_now_filament_num = 0xFF;       ///< Currently active filament number
     uint8_t filament_use_flag = 0x00;           ///< Filament usage flags
-    uint32_t version = BAMBU_BUS_VERSION;       ///< Data structure version
-    uint32_t check = FLASH_MAGIC_NUMBER;        ///< Magic number for data validation
 } data_save;
 
+/*
+ * Persisted schema (BAMBU_BUS_SAVE_SCHEMA)
+ *
+ * Each Flash_kv value is a list of tag, length, value entries. Unknown tags
+ * are skipped and missing tags keep their defaults, so tags can be added
+ * without a migration; only reinterpreting an existing tag needs a new
+ * schema version. Values are parsed in place from flash.
+ */
+enum Bambubus_tag
+{
+    BAMBU_BUS_TAG_ID = 0x01,          // char[8]
+    BAMBU_BUS_TAG_COLOR = 0x02,       // R, G, B, A
+    BAMBU_BUS_TAG_TEMPERATURE = 0x03, // int16 min, int16 max
+    BAMBU_BUS_TAG_NAME = 0x04,        // name without trailing zeros
+    BAMBU_BUS_TAG_METERS = 0x05,      // float
+    BAMBU_BUS_TAG_NOW_FILAMENT = 0x20 // uint8 channel, 0xFF = none
+};
+
+/**
+ * Frozen layout of the raw records written by older firmware
+ * (whole _filament memcpy, Flash_kv version BAMBU_BUS_VERSION, or the
+ * flash_save_struct image at FLASH_SAVE_ADDRESS). Only used for migration.
+ */
+struct _filament_raw_v5
+{
+    char ID[8];
+    uint8_t color_R;
+    uint8_t color_G;
+    uint8_t color_B;
+    uint8_t color_A;
+    int16_t temperature_min;
+    int16_t temperature_max;
+    char name[20];
+    float meters;
+    uint64_t meters_virtual_count;
+    uint32_t statu;
+    uint32_t motion_set;
+    uint16_t pressure;
+};
+struct alignas(4) flash_save_struct_v5
+{
+    _filament_raw_v5 filament[MAX_FILAMENT_CHANNELS];
+    int BambuBus_now_filament_num;
+    uint8_t filament_use_flag;
+    uint32_t version;
+    uint32_t check;
+};
+
+void Bambubus_filament_from_raw(_filament *filament, const _filament_raw_v5 *raw)
+{
+    memcpy(filament->ID, raw->ID, sizeof(filament->ID));
+    filament->color_R = raw->color_R;
+    filament->color_G = raw->color_G;
+    filament->color_B = raw->color_B;
+    filament->color_A = raw->color_A;
+    filament->temperature_min = raw->temperature_min;
+    filament->temperature_max = raw->temperature_max;
+    memcpy(filament->name, raw->name, sizeof(filament->name));
+    filament->meters = raw->meters;
+}
+
+uint8_t *Bambubus_tlv_put(uint8_t *p, uint8_t tag, const void *value, uint8_t length)
+{
+    *p++ = tag;
+    *p++ = length;
+    memcpy(p, value, length);
+    return p + length;
+}
+
+/**
+ * Encode the persisted part of one channel
+ * @return encoded length
+ */
+uint16_t Bambubus_filament_encode(const _filament *filament, uint8_t *buf)
+{
+    uint8_t *p = buf;
+    uint8_t color[4] = {filament->color_R, filament->color_G, filament->color_B, filament->color_A};
+    int16_t temperature[2] = {filament->temperature_min, filament->temperature_max};
+
+    p = Bambubus_tlv_put(p, BAMBU_BUS_TAG_ID, filament->ID, sizeof(filament->ID));
+    p = Bambubus_tlv_put(p, BAMBU_BUS_TAG_COLOR, color, sizeof(color));
+    p = Bambubus_tlv_put(p, BAMBU_BUS_TAG_TEMPERATURE, temperature, sizeof(temperature));
+    p = Bambubus_tlv_put(p, BAMBU_BUS_TAG_NAME, filament->name, strnlen(filament->name, sizeof(filament->name)));
+    p = Bambubus_tlv_put(p, BAMBU_BUS_TAG_METERS, &filament->meters, sizeof(filament->meters));
+    return p - buf;
+}
+
+/**
+ * Decode one channel straight from flash; fields without a tag are left untouched
+ */
+void Bambubus_filament_decode(_filament *filament, const uint8_t *p, uint16_t length)
+{
+    const uint8_t *end = p + length;
+    while (p + 2 <= end)
+    {
+        uint8_t tag = p[0];
+        uint8_t size = p[1];
+        const uint8_t *value = p + 2;
+        p = value + size;
+        if (p > end) // truncated entry
+            break;
+        switch (tag)
+        {
+        case BAMBU_BUS_TAG_ID:
+            if (size == sizeof(filament->ID))
+                memcpy(filament->ID, value, size);
+            break;
+        case BAMBU_BUS_TAG_COLOR:
+            if (size == 4)
+            {
+                filament->color_R = value[0];
+                filament->color_G = value[1];
+                filament->color_B = value[2];
+                filament->color_A = value[3];
+            }
+            break;
+        case BAMBU_BUS_TAG_TEMPERATURE:
+            if (size == 4)
+            {
+                memcpy(&filament->temperature_min, value, 2);
+                memcpy(&filament->temperature_max, value + 2, 2);
+            }
+            break;
+        case BAMBU_BUS_TAG_NAME:
+            if (size <= sizeof(filament->name))
+            {
+                memset(filament->name, 0, sizeof(filament->name));
+                memcpy(filament->name, value, size);
+            }
+            break;
+        case BAMBU_BUS_TAG_METERS:
+            if (size == sizeof(filament->meters))
+                memcpy(&filament->meters, value, size);
+            break;
+        default: // written by newer firmware
+            break;
+        }
+    }
+}
+
+/*
+ * Save coalescing
+ *
+ * Every persisted key (one per channel plus the bus state) has a dirty bit
+ * and the hash of the image last handed to Flash_kv. Changes only mark keys
+ * dirty; once the bus has been quiet for BAMBU_BUS_SAVE_DEBOUNCE_MS (or
+ * BAMBU_BUS_SAVE_MAX_DELAY_MS after the first change) the dirty keys are
+ * re-encoded and only those whose hash changed are queued for writing.
+ */
+#define BAMBU_BUS_SAVE_KEY_STATE MAX_FILAMENT_CHANNELS // index of the bus state key
+uint8_t Bambubus_dirty = 0;                             // bit n: key n may differ from flash
+uint32_t Bambubus_saved_hash[MAX_FILAMENT_CHANNELS + 1]; // hash of the image last written per key
+uint64_t Bambubus_save_time = 0;                        // debounce deadline
+uint64_t Bambubus_save_limit = 0;                       // latest allowed deadline for this burst
+
+// FNV-1a, only used to tell whether an image changed
+uint32_t Bambubus_hash(const void *data, uint16_t length)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t hash = 0x811C9DC5;
+    for (uint16_t i = 0; i < length; i++)
+    {
+        hash ^= p[i];
+        hash *= 0x01000193;
+    }
+    return hash;
+}
+
+// Encode the image persisted for save key n
+uint16_t Bambubus_save_image(int n, uint8_t *key, uint8_t *buf)
+{
+    if (n == BAMBU_BUS_SAVE_KEY_STATE)
+    {
+        uint8_t now_filament = data_save.BambuBus_now_filament_num;
+        *key = FLASH_KV_KEY_BUS_STATE;
+        return Bambubus_tlv_put(buf, BAMBU_BUS_TAG_NOW_FILAMENT, &now_filament, 1) - buf;
+    }
+    *key = FLASH_KV_KEY_FILAMENT + n;
+    return Bambubus_filament_encode(&data_save.filament[n], buf);
+}
+
+// Remember what is in flash now, so the first save after boot is not a blind rewrite
+void Bambubus_save_sync()
+{
+    uint8_t key;
+    uint8_t image[FLASH_KV_MAX_VALUE];
+    for (int n = 0; n <= BAMBU_BUS_SAVE_KEY_STATE; n++)
+    {
+        uint16_t length = Bambubus_save_image(n, &key, image);
+        Bambubus_saved_hash[n] = Bambubus_hash(image, length);
+    }
+}
+
+void Bambubus_mark_dirty(uint8_t keys)
+{
+    uint64_t now = get_time64();
+    if (Bambubus_dirty == 0)
+        Bambubus_save_limit = now + BAMBU_BUS_SAVE_MAX_DELAY_MS;
+    Bambubus_dirty |= keys;
+    Bambubus_save_time = now + BAMBU_BUS_SAVE_DEBOUNCE_MS;
+    if (Bambubus_save_time > Bambubus_save_limit)
+        Bambubus_save_time = Bambubus_save_limit;
+}
+
+/**
+ * Mark one channel's filament data as possibly changed
+ */
+void Bambubus_set_filament_dirty(int num)
+{
+    Bambubus_mark_dirty((1 << num) | (1 << BAMBU_BUS_SAVE_KEY_STATE));
+}
+
+void Bambubus_save()
+{
+    uint8_t key;
+    uint8_t image[FLASH_KV_MAX_VALUE];
+    for (int n = 0; n <= BAMBU_BUS_SAVE_KEY_STATE; n++)
+    {
+        if (!(Bambubus_dirty & (1 << n)))
+            continue;
+        uint16_t length = Bambubus_save_image(n, &key, image);
+        uint32_t hash = Bambubus_hash(image, length);
+        if (hash == Bambubus_saved_hash[n])
+        {
+            Bambubus_dirty &= ~(1 << n);
+        }
+        else if (Flash_kv_write(key, BAMBU_BUS_SAVE_SCHEMA, image, length))
+        {
+            Bambubus_saved_hash[n] = hash;
+            Bambubus_dirty &= ~(1 << n);
+        }
+    }
+    Bambubus_dirty &= (1 << (BAMBU_BUS_SAVE_KEY_STATE + 1)) - 1;
+}
+
 /**
  * Read configuration data from flash memory
+ * Raw records from older firmware are converted and rewritten in the current schema.
  * @return true if valid data was found and loaded, false otherwise
  */
 bool Bambubus_read()
 {
-    const flash_save_struct *ptr = (const flash_save_struct *)(FLASH_SAVE_ADDRESS);
-    
-    if ((ptr->check == FLASH_MAGIC_NUMBER) && (ptr->version == BAMBU_BUS_VERSION))
+    bool have_data = false;
+    uint8_t migrate = 0; // save keys that still hold an old format
+    uint8_t version;
+    uint16_t length;
+
+    for (int i = 0; i < MAX_FILAMENT_CHANNELS; i++)
     {
-        memcpy(&data_save, ptr, sizeof(data_save));
-        return true;
+        const uint8_t *value = (const uint8_t *)Flash_kv_find(FLASH_KV_KEY_FILAMENT + i, &version, &length);
+        if (value == NULL)
+            continue;
+        if (version == BAMBU_BUS_SAVE_SCHEMA)
+        {
+            Bambubus_filament_decode(&data_save.filament[i], value, length);
+            have_data = true;
+        }
+        else if ((version == BAMBU_BUS_VERSION) && (length == sizeof(_filament_raw_v5)))
+        {
+            _filament_raw_v5 raw;
+            memcpy(&raw, value, sizeof(raw)); // flash copy may not be aligned for the 64-bit field
+            Bambubus_filament_from_raw(&data_save.filament[i], &raw);
+            migrate |= 1 << i;
+            have_data = true;
+        }
+    }
+
+    const uint8_t *value = (const uint8_t *)Flash_kv_find(FLASH_KV_KEY_BUS_STATE, &version, &length);
+    if (value && (version == BAMBU_BUS_SAVE_SCHEMA) && (length == 3) && (value[0] == BAMBU_BUS_TAG_NOW_FILAMENT))
+    {
+        data_save.BambuBus_now_filament_num = value[2];
+    }
+    else if (value && (version == BAMBU_BUS_VERSION) && (length == sizeof(int)))
+    {
+        memcpy(&data_save.BambuBus_now_filament_num, value, sizeof(int));
+        migrate |= 1 << BAMBU_BUS_SAVE_KEY_STATE;
+    }
+
+    if (!have_data)
+    {
+        // Legacy whole-struct image from firmware before the key/value log
+        const flash_save_struct_v5 *ptr = (const flash_save_struct_v5 *)Flash_kv_map_address(FLASH_SAVE_ADDRESS);
+        if ((ptr->check != FLASH_MAGIC_NUMBER) || (ptr->version != BAMBU_BUS_VERSION))
+            return false;
+        for (int i = 0; i < MAX_FILAMENT_CHANNELS; i++)
+        {
+            Bambubus_filament_from_raw(&data_save.filament[i], &ptr->filament[i]);
+        }
+        data_save.BambuBus_now_filament_num = ptr->BambuBus_now_filament_num;
+        migrate = 0xFF; // migrate before compaction reclaims the legacy page
     }
-    return false;
-}
-bool Bambubus_need_to_save = false;
-void Bambubus_set_need_to_save()
-{
-    Bambubus_need_to_save = true;
-}
-void Bambubus_save()
-{
-    Flash_saves(&data_save, sizeof(data_save), FLASH_SAVE_ADDRESS);
-}
 
+    Bambubus_save_sync();
+    for (int n = 0; n <= BAMBU_BUS_SAVE_KEY_STATE; n++)
+    {
+        if (migrate & (1 << n))
+            Bambubus_saved_hash[n] = 0;
+    }
+    if (migrate)
+        Bambubus_mark_dirty(migrate);
+    return true;
+}
 int get_now_filament_num()
 {
     return data_save.BambuBus_now_filament_num;
@@ -186,6 +461,7 @@ bool BambuBus_if_on_print()
     return on_print;
 }
 uint8_t buf_X[1000];
+volatile bool BambuBus_rx_in_frame = false; // a frame has started but is not complete yet
 CRC8 _RX_IRQ_crcx(0x39, 0x66, 0x00, false, false);
 void inline RX_IRQ(unsigned char _RX_IRQ_data)
 {
@@ -205,6 +481,7 @@ void inline RX_IRQ(unsigned char _RX_IRQ_data)
             data_length_index = 4;        // unknow package type,init length data to 4
             length = data_CRC8_index = 6; // unknow package length,,init package length to 6
             _index = 1;
+            BambuBus_rx_in_frame = true;
         }
         return;
     }
@@ -237,6 +514,7 @@ void inline RX_IRQ(unsigned char _RX_IRQ_data)
             if (data != _RX_IRQ_crcx.calc()) // check error,return to waiting 0x3D
             {
                 _index = 0;
+                BambuBus_rx_in_frame = false;
                 return;
             }
         }
@@ -244,16 +522,28 @@ void inline RX_IRQ(unsigned char _RX_IRQ_data)
         if (_index >= length) // recv over,copy package data
         {
             _index = 0;
+            BambuBus_rx_in_frame = false;
             memcpy(buf_X, BambuBus_data_buf, length);
             BambuBus_have_data = length;
+            Sched_post(SCHED_BUS);
         }
         if (_index >= 999) // recv error,reset
         {
             _index = 0;
+            BambuBus_rx_in_frame = false;
         }
     }
 }
 
+/**
+ * @brief Check whether the bus is quiet between polls
+ * @return true if no frame is being received, none is waiting to be handled and no reply is on the wire
+ */
+bool BambuBus_is_idle()
+{
+    return !BambuBus_rx_in_frame && (BambuBus_have_data == 0) && !(GPIOA->OUTDR & GPIO_Pin_12);
+}
+
 #include <stdio.h>
 
 DMA_InitTypeDef Bambubus_DMA_InitStructure;
@@ -343,6 +633,7 @@ void USART1_IRQHandler(void)
 void BambuBus_init()
 {
     bool _init_ready = Bambubus_read();
+    Boot_mark(BOOT_BUS_READ);
     crc_8.reset(0x39, 0x66, 0, false, false);
     crc_16.reset(0x1021, 0x913D, 0, false, false);
 
@@ -407,7 +698,8 @@ bool package_check_crc16(uint8_t *data, int data_length)
 bool need_debug = false;
 void package_send_with_crc(uint8_t *data, int data_length)
 {
-
+    TRACE(BUS_TX, (uint16_t)data_length);
+    Boot_mark(BOOT_FIRST_REPLY);
     crc_8.restart();
     if (data[1] & 0x80)
     {
@@ -439,7 +731,7 @@ void package_send_with_crc(uint8_t *data, int data_length)
     if (need_debug)
     {
         memcpy(buf_X + BambuBus_have_data, data, data_length);
-        DEBUG_num(buf_X, BambuBus_have_data + data_length);
+        LOG_num(BUS, TRACE, buf_X, BambuBus_have_data + data_length);
         need_debug = false;
     }
 }
@@ -1182,6 +1474,10 @@ void send_for_set_filament(unsigned char *buf, int length)
     if (AMS_num != BambuBus_AMS_num)
         return;
     read_num = read_num & 0x0F;
+    if (read_num >= MAX_FILAMENT_CHANNELS)
+        return;
+    _filament before;
+    memcpy(&before, &data_save.filament[read_num], sizeof(_filament));
     memcpy(data_save.filament[read_num].ID, buf + 7, sizeof(data_save.filament[read_num].ID));
     data_save.filament[read_num].color_R = buf[15];
     data_save.filament[read_num].color_G = buf[16];
@@ -1192,7 +1488,8 @@ void send_for_set_filament(unsigned char *buf, int length)
     memcpy(&data_save.filament[read_num].temperature_max, buf + 21, 2);
     memcpy(data_save.filament[read_num].name, buf + 23, sizeof(data_save.filament[read_num].name));
     package_send_with_crc(Set_filament_res, sizeof(Set_filament_res));
-    Bambubus_set_need_to_save();
+    if (memcmp(&before, &data_save.filament[read_num], sizeof(_filament)) != 0) // 打印机会重复下发相同数据
+        Bambubus_set_filament_dirty(read_num);
 }
 unsigned char Set_filament_res_type2[] = {0x00, 0x00, 0x00};
 void send_for_set_filament_type2(unsigned char *buf, int length)
@@ -1203,6 +1500,10 @@ void send_for_set_filament_type2(unsigned char *buf, int length)
     if (AMS_num != BambuBus_AMS_num)
         return;
     uint8_t read_num = printer_data_long.datas[1];
+    if (read_num >= MAX_FILAMENT_CHANNELS)
+        return;
+    _filament before;
+    memcpy(&before, &data_save.filament[read_num], sizeof(_filament));
     memcpy(data_save.filament[read_num].ID, printer_data_long.datas + 2, sizeof(data_save.filament[read_num].ID));
 
     data_save.filament[read_num].color_R = printer_data_long.datas[10];
@@ -1213,7 +1514,8 @@ void send_for_set_filament_type2(unsigned char *buf, int length)
     memcpy(&data_save.filament[read_num].temperature_min, printer_data_long.datas + 14, 2);
     memcpy(&data_save.filament[read_num].temperature_max, printer_data_long.datas + 16, 2);
     memcpy(data_save.filament[read_num].name, printer_data_long.datas + 18, 16);
-    Bambubus_set_need_to_save();
+    if (memcmp(&before, &data_save.filament[read_num], sizeof(_filament)) != 0)
+        Bambubus_set_filament_dirty(read_num);
 
     Set_filament_res_type2[0]=BambuBus_AMS_num;
     Set_filament_res_type2[1]=read_num;
@@ -1234,6 +1536,7 @@ BambuBus_package_type BambuBus_run()
     BambuBus_package_type stu = BambuBus_package_type::NONE;
     static uint64_t time_set = 0;
     static uint64_t time_motion = 0;
+    static bool offline = true;
 
     uint64_t timex = get_time64();
 
@@ -1249,6 +1552,7 @@ BambuBus_package_type BambuBus_run()
         need_debug = false;
         delay(1);
         stu = get_packge_type(buf_X, data_length); // have_data
+        TRACE(BUS_RX, (uint8_t)stu, (uint16_t)data_length);
         switch (stu)
         {
         case BambuBus_package_type::heartbeat:
@@ -1295,8 +1599,15 @@ BambuBus_package_type BambuBus_run()
     }
     if (timex > time_set)
     {
+        if (stu == BambuBus_package_type::NONE && !offline)
+            TRACE(BUS_OFFLINE);
+        offline = true;
         stu = BambuBus_package_type::ERROR; // offline
     }
+    else
+    {
+        offline = false;
+    }
     if (timex > time_motion)
     {
         // set_filament_motion(get_now_filament_num(),idle);
@@ -1305,11 +1616,9 @@ BambuBus_package_type BambuBus_run()
             i->motion_set=idle;
         }*/
     }
-    if (Bambubus_need_to_save)
+    if (Bambubus_dirty && (timex >= Bambubus_save_time))
     {
-        Bambubus_save();
-        time_set = get_time64() + 1000;
-        Bambubus_need_to_save = false;
+        Bambubus_save(); // only queues changed images, Flash_kv_run() programs them in the background
     }
 
     // NFC_detect_run();
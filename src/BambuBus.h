@@ -65,8 +65,9 @@ extern "C"
     // Function declarations
     extern void BambuBus_init();
     extern BambuBus_package_type BambuBus_run();
+    extern bool BambuBus_is_idle();
     extern bool Bambubus_read();
-    extern void Bambubus_set_need_to_save();
+    extern void Bambubus_set_filament_dirty(int num);
     extern int get_now_filament_num();
     extern uint16_t get_now_BambuBus_device_type();
     extern void reset_filament_meters(int num);
@@ -0,0 +1,97 @@
+#include "Boot.h"
+#include <stdio.h>
+
+#ifdef ARDUINO_ARCH_CH32
+#include "main.h"
+#else
+#include "Host.h"
+#endif
+
+uint32_t Boot_times[BOOT_PHASE_COUNT];
+uint32_t Boot_reached_mask = 0;
+bool Boot_reported = false;
+
+static_assert(BOOT_PHASE_COUNT <= 32, "Boot_reached_mask holds one bit per phase");
+
+void Boot_mark(Boot_phase phase)
+{
+    if (Boot_reached(phase))
+        return;
+    Boot_times[phase] = micros();
+    Boot_reached_mask |= 1UL << phase;
+}
+
+bool Boot_reached(Boot_phase phase)
+{
+    return Boot_reached_mask & (1UL << phase);
+}
+
+uint32_t Boot_time_us(Boot_phase phase)
+{
+    return Boot_times[phase];
+}
+
+/**
+ * True if the first bus reply has not been sent within BOOT_FIRST_REPLY_BUDGET_MS of reset
+ */
+bool Boot_first_reply_late()
+{
+    if (!Boot_reached(BOOT_FIRST_REPLY))
+        return micros() > BOOT_FIRST_REPLY_BUDGET_MS * 1000UL;
+    return Boot_times[BOOT_FIRST_REPLY] > BOOT_FIRST_REPLY_BUDGET_MS * 1000UL;
+}
+
+/**
+ * One line per phase: name, time since reset and time since the previous
+ * setup() phase (background phases show '-'), all in microseconds
+ */
+void Boot_report()
+{
+#ifdef Debug_log_on
+    static const char *const names[BOOT_PHASE_COUNT] = {
+#define BOOT_PHASE_NAME(name) #name,
+        BOOT_PHASE_TABLE(BOOT_PHASE_NAME)
+#undef BOOT_PHASE_NAME
+    };
+    char buf[64];
+    uint32_t previous = 0;
+    Debug_log_write("Boot: phase at_us took_us\n");
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++)
+    {
+        if (!Boot_reached((Boot_phase)i))
+        {
+            sprintf(buf, "Boot: %s not reached\n", names[i]);
+        }
+        else if (i <= BOOT_SETUP_DONE)
+        {
+            sprintf(buf, "Boot: %s %lu %lu\n", names[i], (unsigned long)Boot_times[i],
+                    (unsigned long)(Boot_times[i] - previous));
+            previous = Boot_times[i];
+        }
+        else
+        {
+            sprintf(buf, "Boot: %s %lu -\n", names[i], (unsigned long)Boot_times[i]);
+        }
+        Debug_log_write(buf);
+    }
+#endif
+}
+
+/**
+ * Print the timeline once when boot has settled; call from the main loop
+ */
+void Boot_run()
+{
+    if (Boot_reported)
+        return;
+    const uint32_t all = (1UL << BOOT_PHASE_COUNT) - 1;
+    if ((Boot_reached_mask != all) && (millis() < BOOT_REPORT_TIMEOUT_MS))
+        return;
+    Boot_reported = true;
+    LOG_IF(BUS, INFO)
+    {
+        Boot_report();
+    }
+    if (Boot_first_reply_late())
+        LOG_MY(BUS, WARN, "Boot: first reply over budget\n");
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "config.h"
+#include <stdint.h>
+
+/**
+ * Boot timeline
+ *
+ * Boot_mark() records, once, the micros() time at which a phase ended.
+ * setup() phases are marked in order, so each one's cost is the gap to the
+ * previous mark; the phases after SETUP_DONE finish in the background.
+ * Boot_run() prints the timeline once everything has been reached (or after
+ * BOOT_REPORT_TIMEOUT_MS) and warns if the first bus reply missed
+ * BOOT_FIRST_REPLY_BUDGET_MS. The "boot" console command prints it again.
+ * Boot.cpp also builds on a PC (see Host.h) for test/test_boot.
+ */
+#define BOOT_PHASE_TABLE(X) \
+    X(SETUP_ENTRY)          \
+    X(RGB_INIT)             \
+    X(FLASH_KV_INIT)        \
+    X(BUS_READ)             \
+    X(BUS_INIT)             \
+    X(DEBUG_INIT)           \
+    X(ADC_INIT)             \
+    X(AS5600_INIT)          \
+    X(MOTOR_DIR)            \
+    X(SETUP_DONE)           \
+    X(ADC_READY)            \
+    X(DIR_PROBE_DONE)       \
+    X(FIRST_REPLY)
+
+enum Boot_phase : uint8_t
+{
+#define BOOT_PHASE_ENUM(name) BOOT_##name,
+    BOOT_PHASE_TABLE(BOOT_PHASE_ENUM)
+#undef BOOT_PHASE_ENUM
+    BOOT_PHASE_COUNT
+};
+
+extern void Boot_mark(Boot_phase phase);
+extern bool Boot_reached(Boot_phase phase);
+extern uint32_t Boot_time_us(Boot_phase phase);
+extern bool Boot_first_reply_late();
+extern void Boot_report();
+extern void Boot_run();
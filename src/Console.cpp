@@ -0,0 +1,416 @@
+#include "Console.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if DEBUG_CONSOLE_ENABLED && defined(Debug_log_on) // replies go out through the debug log
+
+#define CONSOLE_RX_SIZE 128
+static_assert((CONSOLE_RX_SIZE & (CONSOLE_RX_SIZE - 1)) == 0, "CONSOLE_RX_SIZE must be a power of 2");
+uint8_t Console_rx_buf[CONSOLE_RX_SIZE];
+volatile uint32_t Console_rx_head = 0; // written by the RX interrupt only
+volatile uint32_t Console_rx_tail = 0; // written by Console_run only
+volatile uint32_t Console_rx_overrun = 0;
+
+char Console_line[DEBUG_CONSOLE_LINE_MAX + 1];
+int Console_line_length = 0;
+bool Console_line_overflow = false;
+
+enum class Console_type
+{
+    f32,
+    u32,
+};
+
+struct Console_tunable
+{
+    const char *name;
+    void *value;
+    Console_type type;
+    float min;
+    float max;
+    bool is_gain; // re-applied to the PID controllers when changed
+};
+
+const Console_tunable Console_tunables[] = {
+    {"speed_p", &MC_tuning.speed_P, Console_type::f32, 0, 10000, true},
+    {"speed_i", &MC_tuning.speed_I, Console_type::f32, 0, 10000, true},
+    {"speed_d", &MC_tuning.speed_D, Console_type::f32, 0, 10000, true},
+    {"pressure_p", &MC_tuning.pressure_P, Console_type::f32, 0, 100000, true},
+    {"pressure_i", &MC_tuning.pressure_I, Console_type::f32, 0, 100000, true},
+    {"pressure_d", &MC_tuning.pressure_D, Console_type::f32, 0, 100000, true},
+    {"pull_high", &MC_tuning.pull_voltage_high, Console_type::f32, 0, 3.3f, false},
+    {"pull_low", &MC_tuning.pull_voltage_low, Console_type::f32, 0, 3.3f, false},
+    {"pull_send_max", &MC_tuning.pull_voltage_send_max, Console_type::f32, 0, 3.3f, false},
+    {"pull_target_low", &MC_tuning.pull_target_low, Console_type::f32, 0, 3.3f, false},
+    {"pull_target_high", &MC_tuning.pull_target_high, Console_type::f32, 0, 3.3f, false},
+    {"assist_ms", &MC_tuning.assist_send_time_ms, Console_type::u32, 0, 60000, false},
+    {"buffer_mm_per_v", &MC_tuning.buffer_mm_per_v, Console_type::f32, 1, 200, false},
+};
+
+/**
+ * Called from the USART3 RX interrupt; just queues the byte
+ */
+void Console_rx_byte(uint8_t byte)
+{
+    uint32_t head = Console_rx_head;
+    if (head - Console_rx_tail >= CONSOLE_RX_SIZE)
+    {
+        Console_rx_overrun++;
+        return;
+    }
+    Console_rx_buf[head & (CONSOLE_RX_SIZE - 1)] = byte;
+    Console_rx_head = head + 1;
+    if ((byte == '\n') || (byte == '\r'))
+        Sched_post(SCHED_CONSOLE);
+}
+
+/**
+ * printf into buf at len; a line that does not fit is cut short, never overrun
+ * @return the new length
+ */
+static int Console_append(char *buf, int size, int len, const char *format, ...)
+{
+    if (len >= size - 1)
+        return len;
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buf + len, size - len, format, args);
+    va_end(args);
+    if (n < 0)
+        return len;
+    return (len + n < size) ? len + n : size - 1;
+}
+
+// Floats without printf("%f"), 4 decimals; at most 12 characters
+static int Console_append_float(char *buf, int size, int len, float value)
+{
+    const char *sign = (value < 0) ? "-" : "";
+    value = fabsf(value);
+    if (!(value < 400000.0f)) // 放大后要装得下 uint32, NaN 也走这里
+        value = 400000.0f;
+    uint32_t scaled = (uint32_t)(value * 10000 + 0.5f);
+    return Console_append(buf, size, len, "%s%lu.%04lu", sign, (unsigned long)(scaled / 10000),
+                          (unsigned long)(scaled % 10000));
+}
+
+static void Console_reply(const char *text)
+{
+    Debug_log_write(text);
+}
+
+static void Console_print_tunable(const Console_tunable &t)
+{
+    char buf[64];
+    int len = Console_append(buf, sizeof(buf), 0, "OK %s=", t.name);
+    if (t.type == Console_type::f32)
+        len = Console_append_float(buf, sizeof(buf), len, *(float *)t.value);
+    else
+        len = Console_append(buf, sizeof(buf), len, "%lu", (unsigned long)*(uint32_t *)t.value);
+    Console_append(buf, sizeof(buf), len, "\n");
+    Console_reply(buf);
+}
+
+static const Console_tunable *Console_find(const char *name)
+{
+    for (const Console_tunable &t : Console_tunables)
+    {
+        if (strcmp(t.name, name) == 0)
+            return &t;
+    }
+    return NULL;
+}
+
+static void Console_cmd_set(const char *name, const char *arg)
+{
+    const Console_tunable *t = name ? Console_find(name) : NULL;
+    if (t == NULL)
+    {
+        Console_reply("ERR unknown name\n");
+        return;
+    }
+    char *end;
+    float value = arg ? strtof(arg, &end) : 0;
+    if ((arg == NULL) || (end == arg) || (*end != 0) || !(value >= t->min && value <= t->max))
+    {
+        Console_reply("ERR bad value\n");
+        return;
+    }
+    if (t->type == Console_type::f32)
+        *(float *)t->value = value;
+    else
+        *(uint32_t *)t->value = (uint32_t)value;
+    if (t->is_gain)
+        Motion_control_tuning_apply();
+    Console_print_tunable(*t);
+}
+
+static void Console_cmd_stats()
+{
+    char buf[128]; // 第一行最长 117 字节
+    snprintf(buf, sizeof(buf), "OK uptime_ms=%lu log_dropped=%lu rx_overrun=%lu flash_irq_max_us=%lu telemetry_hz=%u\n",
+            (unsigned long)get_time64(), (unsigned long)Debug_log_get_dropped(), (unsigned long)Console_rx_overrun,
+            (unsigned long)Flash_get_irq_masked_max_us(), Telemetry_get_rate());
+    Console_reply(buf);
+    uint32_t change_ms, overlap_ms, changes;
+    Motion_control_change_stats(&change_ms, &overlap_ms, &changes);
+    snprintf(buf, sizeof(buf), "OK changes=%lu change_ms=%lu overlap_ms=%lu\n", (unsigned long)changes, (unsigned long)change_ms,
+            (unsigned long)overlap_ms);
+    Console_reply(buf);
+    for (int i = 0; i < MAX_FILAMENT_CHANNELS; i++)
+    {
+        int len = Console_append(buf, sizeof(buf), 0, "OK ch%d pwm=%d pull=", i, Motion_control_pwm[i]);
+        len = Console_append_float(buf, sizeof(buf), len, MC_PULL_stu_raw[i]);
+        len = Console_append(buf, sizeof(buf), len, " speed=");
+        len = Console_append_float(buf, sizeof(buf), len, speed_as5600[i]);
+        Console_append(buf, sizeof(buf), len, "\n");
+        Console_reply(buf);
+    }
+}
+
+static void Console_cmd_autotune(const char *arg1, const char *arg2)
+{
+    if (arg1 == NULL)
+    {
+        static const char *const states[] = {"idle", "running", "done", "failed"};
+        for (int i = 0; i < MAX_FILAMENT_CHANNELS; i++)
+        {
+            bool pressure;
+            float P, I;
+            int state = Motion_control_autotune_status(i, &pressure, &P, &I);
+            char buf[96];
+            int len = Console_append(buf, sizeof(buf), 0, "OK ch%d %s %s P=", i, pressure ? "pressure" : "speed",
+                                     states[state]);
+            len = Console_append_float(buf, sizeof(buf), len, P);
+            len = Console_append(buf, sizeof(buf), len, " I=");
+            len = Console_append_float(buf, sizeof(buf), len, I);
+            Console_append(buf, sizeof(buf), len, "\n");
+            Console_reply(buf);
+        }
+        return;
+    }
+    if (strcmp(arg1, "clear") == 0)
+    {
+        Motion_control_autotune_clear();
+        Console_reply("OK autotune clear\n");
+        return;
+    }
+    bool pressure = arg2 && (strcmp(arg2, "pressure") == 0);
+    if (arg2 && !pressure && (strcmp(arg2, "speed") != 0))
+    {
+        Console_reply("ERR loop\n");
+        return;
+    }
+    bool all = strcmp(arg1, "all") == 0;
+    if (!all && !(arg1[0] >= '0' && arg1[0] < '0' + MAX_FILAMENT_CHANNELS && arg1[1] == 0))
+    {
+        Console_reply("ERR channel\n");
+        return;
+    }
+    int started = 0;
+    for (int i = 0; i < MAX_FILAMENT_CHANNELS; i++)
+    {
+        if ((all || (i == arg1[0] - '0')) && Motion_control_autotune_start(i, pressure))
+            started++;
+    }
+    if (started && pressure)
+        Console_reply("OK autotune pressure, idle slider and AMS in-use loop\n"); // AMS lite 使用中由速度环按挤出速度送料
+    else
+        Console_reply(started ? "OK autotune\n" : "ERR channel busy\n"); // 打印或换料中, 通道在用, 无耗材或方向未知
+}
+
+static void Console_execute(char *line)
+{
+    // Optional "*HH" checksum: XOR of everything before the '*'
+    char *star = strrchr(line, '*');
+    if (star)
+    {
+        uint8_t sum = 0;
+        for (char *c = line; c < star; c++)
+            sum ^= (uint8_t)*c;
+        char *end;
+        unsigned long given = strtoul(star + 1, &end, 16);
+        if ((end == star + 1) || (*end != 0) || (given != sum))
+        {
+            Console_reply("ERR checksum\n");
+            return;
+        }
+        *star = 0;
+    }
+
+    const char *cmd = strtok(line, " \t");
+    const char *arg1 = strtok(NULL, " \t");
+    const char *arg2 = strtok(NULL, " \t");
+    if (cmd == NULL)
+        return;
+
+    if (strcmp(cmd, "help") == 0)
+    {
+        Console_reply("OK help list get set save defaults relearn telemetry stats profile boot tasks model autotune\n");
+    }
+    else if (strcmp(cmd, "list") == 0)
+    {
+        for (const Console_tunable &t : Console_tunables)
+            Console_print_tunable(t);
+    }
+    else if (strcmp(cmd, "get") == 0)
+    {
+        const Console_tunable *t = arg1 ? Console_find(arg1) : NULL;
+        if (t)
+            Console_print_tunable(*t);
+        else
+            Console_reply("ERR unknown name\n");
+    }
+    else if (strcmp(cmd, "set") == 0)
+    {
+        Console_cmd_set(arg1, arg2);
+    }
+    else if (strcmp(cmd, "save") == 0)
+    {
+        Console_reply(Motion_control_tuning_save() ? "OK saved\n" : "ERR flash queue full\n");
+    }
+    else if (strcmp(cmd, "defaults") == 0)
+    {
+        Motion_control_tuning_defaults();
+        Motion_control_tuning_apply();
+        Console_reply("OK defaults\n");
+    }
+    else if (strcmp(cmd, "relearn") == 0)
+    {
+        if (arg1 && strcmp(arg1, "all") == 0)
+        {
+            reset_all_learned_directions();
+            Console_reply("OK relearn all\n");
+        }
+        else if (arg1 && arg1[0] >= '0' && arg1[0] < '0' + MAX_FILAMENT_CHANNELS && arg1[1] == 0)
+        {
+            reset_direction_learning(arg1[0] - '0');
+            Console_reply("OK relearn\n");
+        }
+        else
+        {
+            Console_reply("ERR channel\n");
+        }
+    }
+    else if (strcmp(cmd, "telemetry") == 0)
+    {
+        char *end;
+        unsigned long hz = arg1 ? strtoul(arg1, &end, 10) : 0;
+        if ((arg1 == NULL) || (end == arg1) || (*end != 0) || (hz > TELEMETRY_MAX_RATE_HZ))
+        {
+            Console_reply("ERR rate\n");
+            return;
+        }
+        Telemetry_set_rate(hz);
+        char buf[32];
+        snprintf(buf, sizeof(buf), "OK telemetry_hz=%u\n", Telemetry_get_rate()); // stays 0 without DEBUG_TRACE_ENABLED
+        Console_reply(buf);
+    }
+    else if (strcmp(cmd, "stats") == 0)
+    {
+        Console_cmd_stats();
+    }
+    else if (strcmp(cmd, "model") == 0)
+    {
+        if (arg1 && strcmp(arg1, "reset") == 0)
+        {
+            Motion_control_model_reset();
+            Console_reply("OK model reset\n");
+            return;
+        }
+        for (int i = 0; i < MAX_FILAMENT_CHANNELS; i++)
+        {
+            float breakaway, offset, gain;
+            int samples;
+            bool valid = Motion_control_model_get(i, &breakaway, &offset, &gain, &samples);
+            char buf[128];
+            int len = Console_append(buf, sizeof(buf), 0, "OK ch%d valid=%d samples=%d breakaway=", i, valid, samples);
+            len = Console_append_float(buf, sizeof(buf), len, breakaway);
+            len = Console_append(buf, sizeof(buf), len, " offset=");
+            len = Console_append_float(buf, sizeof(buf), len, offset);
+            len = Console_append(buf, sizeof(buf), len, " gain=");
+            len = Console_append_float(buf, sizeof(buf), len, gain);
+            Console_append(buf, sizeof(buf), len, "\n");
+            Console_reply(buf);
+        }
+    }
+    else if (strcmp(cmd, "autotune") == 0)
+    {
+        Console_cmd_autotune(arg1, arg2);
+    }
+    else if (strcmp(cmd, "tasks") == 0)
+    {
+        if (arg1 && strcmp(arg1, "reset") == 0)
+        {
+            Sched_reset();
+            Console_reply("OK tasks reset\n");
+        }
+        else
+            Sched_dump();
+    }
+    else if (strcmp(cmd, "boot") == 0)
+    {
+        Boot_report();
+    }
+    else if (strcmp(cmd, "profile") == 0)
+    {
+        if (!PROFILE_ENABLED)
+            Console_reply("ERR PROFILE_ENABLED is 0\n");
+        else if (arg1 && strcmp(arg1, "reset") == 0)
+        {
+            Profile_reset();
+            Console_reply("OK profile reset\n");
+        }
+        else
+            Profile_dump();
+    }
+    else
+    {
+        Console_reply("ERR unknown command\n");
+    }
+}
+
+/**
+ * Assemble received bytes into lines and run complete ones; call from the main loop
+ */
+void Console_run()
+{
+    while (Console_rx_tail != Console_rx_head)
+    {
+        char c = Console_rx_buf[Console_rx_tail & (CONSOLE_RX_SIZE - 1)];
+        Console_rx_tail = Console_rx_tail + 1;
+        if ((c == '\n') || (c == '\r'))
+        {
+            if (Console_line_overflow)
+                Console_reply("ERR line too long\n");
+            else if (Console_line_length)
+            {
+                Console_line[Console_line_length] = 0;
+                Console_execute(Console_line);
+            }
+            Console_line_length = 0;
+            Console_line_overflow = false;
+        }
+        else if (Console_line_length < DEBUG_CONSOLE_LINE_MAX)
+        {
+            Console_line[Console_line_length++] = c;
+        }
+        else
+        {
+            Console_line_overflow = true;
+        }
+    }
+}
+
+#else
+
+void Console_rx_byte(uint8_t byte)
+{
+}
+
+void Console_run()
+{
+}
+
+#endif
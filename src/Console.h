@@ -0,0 +1,34 @@
+#pragma once
+
+#include "main.h"
+#include "config.h"
+
+/**
+ * Command console on the debug UART
+ *
+ * The USART3 RX interrupt only queues bytes; Console_run() assembles lines
+ * and executes them from the main loop. One command per line, optionally
+ * followed by "*HH", the XOR of all characters before '*' in hex (NMEA
+ * style), for scripted use over noisy links. Replies are text lines starting
+ * with "OK" or "ERR".
+ *
+ *   help                   list commands
+ *   list                   all tunables and their values
+ *   get <name>             one tunable
+ *   set <name> <value>     change a tunable (takes effect immediately)
+ *   save                   persist tunables to flash
+ *   defaults               restore config.h values (not persisted until save)
+ *   relearn <ch|all>       forget the learned motor direction
+ *   telemetry <hz>         telemetry rate, 0 = off
+ *   stats                  runtime counters
+ *   profile [reset]        main-loop region timings (PROFILE_ENABLED)
+ *   boot                   boot phase timeline
+ *   tasks [reset]          scheduler statistics and CPU load
+ *   model [reset]          identified motor model per channel
+ *   autotune [<ch|all> [speed|pressure]|clear]
+ *                          relay PID auto-tune; the pressure loop drives the
+ *                          buffer slider of an idle channel and, on the AMS
+ *                          (P1X), a channel in use
+ */
+extern void Console_rx_byte(uint8_t byte);
+extern void Console_run();
@@ -4,10 +4,62 @@
 #include <string.h>
 
 #ifdef Debug_log_on
-uint32_t stack[1000];
 // mbed::Timer USB_debug_timer;
 DMA_InitTypeDef Debug_log_DMA_InitStructure;
 
+/*
+ * Log ring
+ *
+ * Writers reserve space by CAS on Debug_log_reserved, copy their bytes and
+ * then publish them through Debug_log_committed. Writers only ever nest (an
+ * interrupt preempting the main loop or a lower priority interrupt), so
+ * when the outermost writer leaves, every reservation made so far has been
+ * filled; it then raises Debug_log_committed to the reservation point with
+ * a CAS-max, which also makes a stale publish from an interrupted writer
+ * harmless. Nothing blocks: a message that does not fit is dropped and
+ * counted.
+ *
+ * DMA1 channel 2 drains committed bytes in contiguous chunks; its transfer
+ * complete interrupt retires the chunk and starts the next one.
+ */
+static_assert((DEBUG_LOG_BUFFER_SIZE & (DEBUG_LOG_BUFFER_SIZE - 1)) == 0, "DEBUG_LOG_BUFFER_SIZE must be a power of 2");
+uint8_t Debug_log_buf[DEBUG_LOG_BUFFER_SIZE];
+volatile uint32_t Debug_log_reserved = 0;  // end of the last reservation
+volatile uint32_t Debug_log_committed = 0; // end of the bytes that are complete
+volatile uint32_t Debug_log_tail = 0;      // start of the bytes not yet sent
+volatile uint32_t Debug_log_sending = 0;   // length of the chunk DMA is sending
+volatile uint32_t Debug_log_depth = 0;     // writers currently inside Debug_log_write_num
+volatile uint32_t Debug_log_dropped = 0;   // messages lost because the ring was full
+volatile uint32_t Debug_log_dma_busy = 0;
+bool Debug_log_ready = false;              // DMA set up; earlier messages wait in the ring
+
+// Start the next chunk if DMA is idle; safe to call from any context
+void Debug_log_kick()
+{
+    if (!Debug_log_ready)
+        return;
+    while (__atomic_exchange_n(&Debug_log_dma_busy, 1, __ATOMIC_ACQUIRE) == 0)
+    {
+        uint32_t tail = Debug_log_tail;
+        uint32_t length = Debug_log_committed - tail;
+        if (length)
+        {
+            uint32_t offset = tail & (DEBUG_LOG_BUFFER_SIZE - 1);
+            if (length > DEBUG_LOG_BUFFER_SIZE - offset)
+                length = DEBUG_LOG_BUFFER_SIZE - offset; // up to the wrap, the rest is the next chunk
+            Debug_log_sending = length;
+            DMA_Cmd(DMA1_Channel2, DISABLE);
+            DMA1_Channel2->MADDR = (uint32_t)&Debug_log_buf[offset];
+            DMA1_Channel2->CNTR = length;
+            DMA_Cmd(DMA1_Channel2, ENABLE);
+            return; // busy until the TC interrupt
+        }
+        __atomic_store_n(&Debug_log_dma_busy, 0, __ATOMIC_RELEASE);
+        if (Debug_log_committed == Debug_log_tail) // nothing was published while we were looking
+            return;
+    }
+}
+
 void Debug_log_init()
 {
 
@@ -56,8 +108,20 @@ void Debug_log_init()
     Debug_log_DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
     Debug_log_DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
     Debug_log_DMA_InitStructure.DMA_BufferSize = 0;
+    DMA_DeInit(DMA1_Channel2);
+    DMA_Init(DMA1_Channel2, &Debug_log_DMA_InitStructure);
+    DMA_ITConfig(DMA1_Channel2, DMA_IT_TC, ENABLE);
+
+    NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel2_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 3; // lowest, logging must never delay the bus
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
 
     USART_Cmd(USART3, ENABLE);
+    USART_DMACmd(USART3, USART_DMAReq_Tx, ENABLE);
+    Debug_log_ready = true;
+    Debug_log_kick(); // anything logged before init
 }
 
 uint64_t Debug_log_count64()
@@ -76,52 +140,117 @@ void Debug_log_write(const void *data)
     Debug_log_write_num((const char *)data, i);
 }
 
+/**
+ * Queue bytes for output. Never blocks and may be called from interrupts;
+ * if the ring is full the message is dropped and counted.
+ */
 void Debug_log_write_num(const void *data, int num)
 {
-    DMA_DeInit(DMA1_Channel2);
-    // Configure DMA1 channel 2 for USART3 TX
-    Debug_log_DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)data;
-    Debug_log_DMA_InitStructure.DMA_BufferSize = num;
-    DMA_Init(DMA1_Channel2, &Debug_log_DMA_InitStructure);
-    DMA_Cmd(DMA1_Channel2, ENABLE);
-    // 使能USART3 DMA发送
-    USART_DMACmd(USART3, USART_DMAReq_Tx, ENABLE);
+    if (num <= 0)
+        return;
+    __atomic_add_fetch(&Debug_log_depth, 1, __ATOMIC_ACQUIRE);
+
+    uint32_t start = Debug_log_reserved;
+    bool reserved = false;
+    do
+    {
+        if ((uint32_t)num > DEBUG_LOG_BUFFER_SIZE - (start - Debug_log_tail))
+            break;
+        reserved = __atomic_compare_exchange_n(&Debug_log_reserved, (uint32_t *)&start, start + num, true,
+                                               __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+    } while (!reserved);
+
+    if (reserved)
+    {
+        const uint8_t *src = (const uint8_t *)data;
+        for (int i = 0; i < num; i++)
+        {
+            Debug_log_buf[(start + i) & (DEBUG_LOG_BUFFER_SIZE - 1)] = src[i];
+        }
+    }
+    else
+    {
+        __atomic_add_fetch(&Debug_log_dropped, 1, __ATOMIC_RELAXED);
+    }
+
+    if (__atomic_sub_fetch(&Debug_log_depth, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        // Outermost writer: everything reserved so far is complete
+        uint32_t end = Debug_log_reserved;
+        uint32_t committed = Debug_log_committed;
+        while (((int32_t)(end - committed) > 0) &&
+               !__atomic_compare_exchange_n(&Debug_log_committed, (uint32_t *)&committed, end, true, __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED))
+        {
+        }
+        Debug_log_kick();
+    }
 }
 
+/**
+ * @return number of messages dropped because the log ring was full
+ */
+uint32_t Debug_log_get_dropped()
+{
+    return Debug_log_dropped;
+}
+
+/**
+ * Format a prefix and a float into a local buffer; it is copied into the
+ * log ring, so the stack buffer may go away as soon as this returns.
+ */
 void Debug_log_write_float(const void *prefix, float value, int precision)
 {
-    char buffer[32];
-    int prefix_len = strlen((const char*)prefix);
+    char buffer[48];
+    int prefix_len = strnlen((const char *)prefix, 16);
     memcpy(buffer, prefix, prefix_len);
-    
+    if (precision > 8)
+        precision = 8;
+
     // Convert float to string with specified precision
+    int len = prefix_len;
+    if (value < 0)
+    {
+        buffer[len++] = '-'; // also for -1 < value < 0, where the integer part is 0
+        value = -value;
+    }
     int int_part = (int)value;
     float frac_part = value - int_part;
-    if (frac_part < 0) frac_part = -frac_part;
-    
-    int len = sprintf(buffer + prefix_len, "%d", int_part);
+
+    len += sprintf(buffer + len, "%d", int_part);
     if (precision > 0) {
-        buffer[prefix_len + len] = '.';
-        len++;
+        buffer[len++] = '.';
         for (int i = 0; i < precision; i++) {
             frac_part *= 10;
             int digit = (int)frac_part;
-            buffer[prefix_len + len + i] = '0' + digit;
+            buffer[len++] = '0' + digit;
             frac_part -= digit;
         }
-        len += precision;
     }
-    
-    Debug_log_write_num(buffer, prefix_len + len);
+
+    Debug_log_write_num(buffer, len);
+}
+
+// Chunk sent: retire it and chain the next one
+extern "C" void DMA1_Channel2_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
+void DMA1_Channel2_IRQHandler(void)
+{
+    if (DMA_GetITStatus(DMA1_IT_TC2) != RESET)
+    {
+        DMA_ClearITPendingBit(DMA1_IT_GL2);
+        Debug_log_tail += Debug_log_sending;
+        Debug_log_sending = 0;
+        __atomic_store_n(&Debug_log_dma_busy, 0, __ATOMIC_RELEASE);
+        Debug_log_kick();
+    }
 }
 
+extern "C" void USART3_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
 void USART3_IRQHandler(void)
 {
     if (USART_GetITStatus(USART3, USART_IT_RXNE) != RESET)
     {
-        // uint8_t x =
-        USART_ReceiveData(USART3);
-        // USART_SendData(USART3, x);
+        Console_rx_byte(USART_ReceiveData(USART3)); // parsed by Console_run() in the main loop
     }
 }
 
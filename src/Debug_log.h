@@ -5,7 +5,11 @@
 
 // Debug logging configuration
 #define Debug_log_on
+#if DEBUG_TRACE_ENABLED
+#define Debug_log_baudrate DEBUG_TRACE_BAUDRATE
+#else
 #define Debug_log_baudrate DEBUG_UART_BAUDRATE
+#endif
 
 #ifdef __cplusplus
 extern "C"
@@ -17,6 +21,7 @@ extern "C"
     extern void Debug_log_write(const void *data);
     extern void Debug_log_write_num(const void *data, int num);
     extern void Debug_log_write_float(const void *data, float value, int precision);
+    extern uint32_t Debug_log_get_dropped();
 
 #ifdef Debug_log_on
     #define DEBUG_init() Debug_log_init()
@@ -39,3 +44,27 @@ extern "C"
 #ifdef __cplusplus
 }
 #endif
+
+/**
+ * Leveled, per-module logging
+ *
+ * module is BUS, MOTION, SENSOR, FLASH or LED and level is ERROR, WARN, INFO
+ * or TRACE; DEBUG_LOG_<module> in config.h sets how much of each module is
+ * kept. The test is a constant expression, so a disabled site is discarded
+ * by the compiler together with its string literals, even at -O0.
+ *
+ *   LOG_MY(FLASH, WARN, "queue full\n");
+ *   LOG_IF(MOTION, TRACE)
+ *   {
+ *       DEBUG_MY("speed="); DEBUG_float(speed, 2); DEBUG_MY("\n");
+ *   }
+ */
+#ifdef Debug_log_on
+    #define LOG_ENABLED(module, level) (DEBUG_LOG_##module >= LOG_LEVEL_##level)
+#else
+    #define LOG_ENABLED(module, level) false
+#endif
+#define LOG_IF(module, level) if constexpr (LOG_ENABLED(module, level))
+#define LOG_MY(module, level, logs) do { LOG_IF(module, level) DEBUG_MY(logs); } while(0)
+#define LOG_num(module, level, logs, num) do { LOG_IF(module, level) DEBUG_num(logs, num); } while(0)
+#define LOG_float(module, level, value, precision) do { LOG_IF(module, level) DEBUG_float(value, precision); } while(0)
@@ -0,0 +1,510 @@
+#include "Flash_kv.h"
+
+#ifdef ARDUINO_ARCH_CH32
+#include "main.h"
+#include "CRC32.h"
+#define Flash_kv_map(address) ((const uint8_t *)(address))
+#else
+#include "Flash_sim.h" // host build, see test/test_flash_kv
+#define Flash_kv_map(address) Flash_sim_map(address)
+#endif
+
+/*
+ * Page layout (all fields little-endian half-words, programmed in order):
+ *   [0]  magic (4 bytes)  - written last during compaction, marks the page valid
+ *   [4]  sequence number  - newest valid page wins at boot
+ *   [6]  ~sequence number
+ *   [8]  records...
+ *
+ * Record layout:
+ *   key | version << 8, length, data (padded to a half-word with 0xFF),
+ *   CRC32 low half-word, CRC32 high half-word
+ *
+ * An erased half-word reads 0xFFFF, so the first record whose key/version
+ * half-word is 0xFFFF marks the end of the log.
+ */
+#define FLASH_KV_MAGIC 0x324B5346UL     // "FSK2"
+#define FLASH_KV_HEAD_SIZE 8            // page header size
+#define FLASH_KV_RECORD_OVERHEAD 8      // key/version + length + CRC32
+#define FLASH_KV_EMPTY 0xFFFF
+
+CRC32 Flash_kv_crc;
+int Flash_kv_active = -1;                   // active page, -1 until the log is formatted
+uint16_t Flash_kv_seq = 0;                  // sequence number of the active page
+uint16_t Flash_kv_write_offset = 0;         // next free offset inside the active page
+uint16_t Flash_kv_index[FLASH_KV_MAX_KEYS]; // offset of the latest valid record per key, 0 = none
+
+static inline uint32_t Flash_kv_page_address(int page)
+{
+    return FLASH_KV_BASE_ADDRESS + (uint32_t)page * FLASH_PAGE_SIZE;
+}
+
+static inline uint16_t Flash_kv_read16(uint32_t address)
+{
+    return *(const volatile uint16_t *)Flash_kv_map(address);
+}
+
+static inline uint16_t Flash_kv_padded(uint16_t length)
+{
+    return (length + 1) & ~1;
+}
+
+uint32_t Flash_kv_calc_crc(uint16_t key_version, uint16_t length, const uint8_t *data)
+{
+    Flash_kv_crc.restart();
+    Flash_kv_crc.add(key_version & 0xFF);
+    Flash_kv_crc.add(key_version >> 8);
+    Flash_kv_crc.add(length & 0xFF);
+    Flash_kv_crc.add(length >> 8);
+    for (uint16_t i = 0; i < length; i++)
+    {
+        Flash_kv_crc.add(data[i]);
+    }
+    uint32_t crc = Flash_kv_crc.calc();
+    if (crc == 0xFFFFFFFF) // 未编程的校验位不能被当作有效
+        crc = 0xFFFFFFFE;
+    return crc;
+}
+
+bool Flash_kv_page_valid(int page, uint16_t *seq)
+{
+    uint32_t address = Flash_kv_page_address(page);
+    uint32_t magic = Flash_kv_read16(address) | ((uint32_t)Flash_kv_read16(address + 2) << 16);
+    uint16_t page_seq = Flash_kv_read16(address + 4);
+    if ((magic != FLASH_KV_MAGIC) || (Flash_kv_read16(address + 6) != (uint16_t)~page_seq))
+        return false;
+    *seq = page_seq;
+    return true;
+}
+
+/**
+ * Walk the active page, index the latest valid record of every key and
+ * locate the append position. A torn record header stops the walk and
+ * forces a compaction on the next write.
+ */
+void Flash_kv_scan()
+{
+    uint32_t base = Flash_kv_page_address(Flash_kv_active);
+    uint16_t offset = FLASH_KV_HEAD_SIZE;
+
+    memset(Flash_kv_index, 0, sizeof(Flash_kv_index));
+    while (offset + FLASH_KV_RECORD_OVERHEAD <= FLASH_PAGE_SIZE)
+    {
+        uint16_t key_version = Flash_kv_read16(base + offset);
+        if (key_version == FLASH_KV_EMPTY) // end of log
+            break;
+
+        uint16_t length = Flash_kv_read16(base + offset + 2);
+        uint16_t size = FLASH_KV_RECORD_OVERHEAD + Flash_kv_padded(length);
+        if ((length > FLASH_KV_MAX_VALUE) || (offset + size > FLASH_PAGE_SIZE))
+        {
+            offset = FLASH_PAGE_SIZE; // 记录头损坏，下次写入时整理
+            break;
+        }
+
+        const uint8_t *data = Flash_kv_map(base + offset + 4);
+        uint32_t crc_address = base + offset + 4 + Flash_kv_padded(length);
+        uint32_t crc = Flash_kv_read16(crc_address) | ((uint32_t)Flash_kv_read16(crc_address + 2) << 16);
+        uint8_t key = key_version & 0xFF;
+        if ((key < FLASH_KV_MAX_KEYS) && (crc == Flash_kv_calc_crc(key_version, length, data)))
+        {
+            Flash_kv_index[key] = offset;
+        }
+        offset += size;
+    }
+    Flash_kv_write_offset = offset;
+}
+
+/**
+ * Locate the newest valid page and rebuild the key index
+ * Nothing is erased here: an unformatted log is only created on first write,
+ * so legacy images in the same pages can still be migrated during boot.
+ */
+void Flash_kv_queue_clear();
+
+void Flash_kv_init()
+{
+    uint16_t seq = 0;
+
+    Flash_kv_queue_clear(); // 上电时本来就是空的, 主机测试模拟重启时需要
+    Flash_kv_crc.reset(0x04C11DB7, 0xFFFFFFFF, 0xFFFFFFFF, true, true);
+    Flash_kv_active = -1;
+    Flash_kv_seq = 0;
+    for (int page = 0; page < FLASH_KV_PAGE_COUNT; page++)
+    {
+        if (Flash_kv_page_valid(page, &seq) && ((Flash_kv_active < 0) || ((int16_t)(seq - Flash_kv_seq) > 0)))
+        {
+            Flash_kv_active = page;
+            Flash_kv_seq = seq;
+        }
+    }
+
+    if (Flash_kv_active >= 0)
+    {
+        Flash_kv_scan();
+    }
+    else
+    {
+        memset(Flash_kv_index, 0, sizeof(Flash_kv_index));
+        Flash_kv_write_offset = FLASH_PAGE_SIZE;
+    }
+}
+
+/**
+ * Read pointer for an address in the log's pages, e.g. the legacy image at
+ * FLASH_SAVE_ADDRESS; on a PC it points into the simulated flash
+ */
+const void *Flash_kv_map_address(uint32_t address)
+{
+    return Flash_kv_map(address);
+}
+
+/**
+ * Look up the latest record of a key
+ * @return Pointer to the value in flash (read it in place), or NULL if absent
+ */
+const void *Flash_kv_find(uint8_t key, uint8_t *version, uint16_t *length)
+{
+    if ((Flash_kv_active < 0) || (key >= FLASH_KV_MAX_KEYS) || (Flash_kv_index[key] == 0))
+        return NULL;
+
+    uint32_t address = Flash_kv_page_address(Flash_kv_active) + Flash_kv_index[key];
+    if (version)
+        *version = Flash_kv_read16(address) >> 8;
+    if (length)
+        *length = Flash_kv_read16(address + 2);
+    return Flash_kv_map(address + 4);
+}
+
+/**
+ * Copy a value out of the log
+ * @return true only if the stored version and length match exactly
+ */
+bool Flash_kv_read(uint8_t key, uint8_t version, void *buf, uint16_t length)
+{
+    uint8_t stored_version;
+    uint16_t stored_length;
+    const void *data = Flash_kv_find(key, &stored_version, &stored_length);
+
+    if ((data == NULL) || (stored_version != version) || (stored_length != length))
+        return false;
+    memcpy(buf, data, length);
+    return true;
+}
+
+/*
+ * Background writer
+ *
+ * Flash_kv_write() only snapshots the value into a queue slot. Flash_kv_run()
+ * is called from the main loop and advances the head job by one small step:
+ * a single page erase, or at most FLASH_KV_STEP_HALFWORDS half-word programs.
+ * Steps only start while the bus is idle, so a reply is never delayed by a
+ * flash operation that was started in the middle of a frame.
+ */
+struct Flash_kv_pending
+{
+    uint8_t key;
+    uint8_t version;
+    uint16_t length;
+    uint8_t data[FLASH_KV_MAX_VALUE];
+};
+Flash_kv_pending Flash_kv_queue[FLASH_KV_QUEUE_SIZE];
+int Flash_kv_queue_count = 0;
+
+enum class Flash_kv_job_state
+{
+    idle,
+    erase,  // erase the compaction target page
+    copy,   // pick the next live record to carry over
+    record, // program the record under the cursor
+    header  // write the compaction target's page header
+};
+
+struct Flash_kv_job_struct
+{
+    Flash_kv_job_state state = Flash_kv_job_state::idle;
+    bool compacting = false;
+    int target = 0;                          // page being written
+    uint16_t offset = 0;                     // write position inside target
+    int copy_key = 0;                        // next key to carry over during compaction
+    uint16_t new_index[FLASH_KV_MAX_KEYS];   // index of the target page while compacting
+    // record cursor
+    uint32_t address = 0;
+    const uint8_t *data = NULL;
+    uint16_t key_version = 0;
+    uint16_t length = 0;
+    uint32_t crc = 0;
+    uint16_t position = 0;                   // half-words programmed so far
+    uint16_t count = 0;                      // half-words in the record
+} Flash_kv_job;
+
+void Flash_kv_cursor_set(uint32_t address, uint16_t key_version, const uint8_t *data, uint16_t length)
+{
+    Flash_kv_job.address = address;
+    Flash_kv_job.key_version = key_version;
+    Flash_kv_job.data = data;
+    Flash_kv_job.length = length;
+    Flash_kv_job.crc = Flash_kv_calc_crc(key_version, length, data);
+    Flash_kv_job.position = 0;
+    Flash_kv_job.count = (FLASH_KV_RECORD_OVERHEAD + Flash_kv_padded(length)) / 2;
+    Flash_kv_job.state = Flash_kv_job_state::record;
+}
+
+// Half-word i of the record under the cursor; the CRC is programmed last so a
+// record cut short by power loss never validates.
+uint16_t Flash_kv_cursor_halfword(uint16_t i)
+{
+    if (i == 0)
+        return Flash_kv_job.key_version;
+    if (i == 1)
+        return Flash_kv_job.length;
+    if (i == Flash_kv_job.count - 2)
+        return Flash_kv_job.crc & 0xFFFF;
+    if (i == Flash_kv_job.count - 1)
+        return Flash_kv_job.crc >> 16;
+    uint16_t byte = (i - 2) * 2;
+    uint16_t half_word = Flash_kv_job.data[byte];
+    half_word |= (byte + 1 < Flash_kv_job.length) ? (Flash_kv_job.data[byte + 1] << 8) : 0xFF00;
+    return half_word;
+}
+
+bool Flash_kv_unchanged(const Flash_kv_pending *pending)
+{
+    uint8_t stored_version;
+    uint16_t stored_length;
+    const void *stored = Flash_kv_find(pending->key, &stored_version, &stored_length);
+    return stored && (stored_version == pending->version) && (stored_length == pending->length) &&
+           (memcmp(stored, pending->data, pending->length) == 0);
+}
+
+void Flash_kv_job_finish(bool ok)
+{
+    static uint32_t reported_irq_masked_us = 0;
+    static bool retried = false;
+    Flash_write_end();
+    Flash_kv_job.state = Flash_kv_job_state::idle;
+    TRACE(FLASH_JOB, Flash_kv_queue[0].key, (uint8_t)ok, Flash_get_irq_masked_max_us());
+    if (!ok)
+    {
+        LOG_MY(FLASH, ERROR, "Flash_kv write failed\n");
+        if (!retried)
+        {
+            // Keep the value queued and retry once on a freshly erased page
+            retried = true;
+            Flash_kv_write_offset = FLASH_PAGE_SIZE;
+            return;
+        }
+    }
+    else if (Flash_get_irq_masked_max_us() > reported_irq_masked_us)
+    {
+        reported_irq_masked_us = Flash_get_irq_masked_max_us();
+        LOG_IF(FLASH, INFO)
+        {
+            DEBUG_MY("Flash_kv IRQ masked max us: ");
+            DEBUG_float(reported_irq_masked_us, 0);
+            DEBUG_MY("\n");
+        }
+    }
+    retried = false;
+    Flash_kv_queue_count--;
+    memmove(&Flash_kv_queue[0], &Flash_kv_queue[1], Flash_kv_queue_count * sizeof(Flash_kv_pending));
+}
+
+// Pick the next live record to carry over, or the new record once all are copied
+void Flash_kv_job_copy_next()
+{
+    const Flash_kv_pending *pending = &Flash_kv_queue[0];
+    uint32_t base = Flash_kv_page_address(Flash_kv_job.target);
+
+    while ((Flash_kv_active >= 0) && (Flash_kv_job.copy_key < FLASH_KV_MAX_KEYS))
+    {
+        int key = Flash_kv_job.copy_key++;
+        if ((Flash_kv_index[key] == 0) || (key == pending->key))
+            continue;
+        uint32_t source = Flash_kv_page_address(Flash_kv_active) + Flash_kv_index[key];
+        uint16_t source_length = Flash_kv_read16(source + 2);
+        Flash_kv_job.new_index[key] = Flash_kv_job.offset;
+        Flash_kv_cursor_set(base + Flash_kv_job.offset, Flash_kv_read16(source), Flash_kv_map(source + 4),
+                            source_length);
+        Flash_kv_job.offset += FLASH_KV_RECORD_OVERHEAD + Flash_kv_padded(source_length);
+        return;
+    }
+
+    uint16_t size = FLASH_KV_RECORD_OVERHEAD + Flash_kv_padded(pending->length);
+    if (Flash_kv_job.offset + size > FLASH_PAGE_SIZE)
+    {
+        Flash_kv_job_finish(false); // live data no longer fits in one page
+        return;
+    }
+    Flash_kv_job.new_index[pending->key] = Flash_kv_job.offset;
+    Flash_kv_cursor_set(base + Flash_kv_job.offset, pending->key | (pending->version << 8), pending->data,
+                        pending->length);
+    Flash_kv_job.offset += size;
+    Flash_kv_job.copy_key = FLASH_KV_MAX_KEYS + 1; // marks the cursor as the new record
+}
+
+void Flash_kv_job_start()
+{
+    const Flash_kv_pending *pending = &Flash_kv_queue[0];
+    uint16_t size = FLASH_KV_RECORD_OVERHEAD + Flash_kv_padded(pending->length);
+
+    if (Flash_kv_unchanged(pending))
+    {
+        Flash_kv_queue_count--;
+        memmove(&Flash_kv_queue[0], &Flash_kv_queue[1], Flash_kv_queue_count * sizeof(Flash_kv_pending));
+        return;
+    }
+
+    Flash_write_begin();
+    if ((Flash_kv_active >= 0) && (Flash_kv_write_offset + size <= FLASH_PAGE_SIZE))
+    {
+        Flash_kv_job.compacting = false;
+        Flash_kv_job.target = Flash_kv_active;
+        Flash_kv_job.offset = Flash_kv_write_offset;
+        Flash_kv_write_offset += size; // the slot is consumed even if programming fails
+        Flash_kv_cursor_set(Flash_kv_page_address(Flash_kv_active) + Flash_kv_job.offset,
+                            pending->key | (pending->version << 8), pending->data, pending->length);
+    }
+    else
+    {
+        Flash_kv_job.compacting = true;
+        Flash_kv_job.target = (Flash_kv_active < 0) ? 0 : (Flash_kv_active + 1) % FLASH_KV_PAGE_COUNT;
+        Flash_kv_job.offset = FLASH_KV_HEAD_SIZE;
+        Flash_kv_job.copy_key = 0;
+        memset(Flash_kv_job.new_index, 0, sizeof(Flash_kv_job.new_index));
+        Flash_kv_job.state = Flash_kv_job_state::erase;
+    }
+}
+
+void Flash_kv_queue_clear()
+{
+    Flash_kv_queue_count = 0;
+    Flash_kv_job.state = Flash_kv_job_state::idle;
+}
+
+/**
+ * Advance the background writer by one step
+ * @param bus_idle true when no frame is being received or sent
+ */
+void Flash_kv_run(bool bus_idle)
+{
+    if (!bus_idle)
+        return;
+    if (Flash_kv_job.state == Flash_kv_job_state::idle)
+    {
+        if (Flash_kv_queue_count == 0)
+            return;
+        Flash_kv_job_start();
+        return;
+    }
+
+    switch (Flash_kv_job.state)
+    {
+    case Flash_kv_job_state::erase:
+        if (!Flash_erase_page(Flash_kv_page_address(Flash_kv_job.target)))
+        {
+            Flash_kv_job_finish(false);
+            break;
+        }
+        Flash_kv_job.state = Flash_kv_job_state::copy;
+        break;
+    case Flash_kv_job_state::copy:
+        Flash_kv_job_copy_next();
+        break;
+    case Flash_kv_job_state::record:
+    {
+        for (int n = 0; (n < FLASH_KV_STEP_HALFWORDS) && (Flash_kv_job.position < Flash_kv_job.count); n++)
+        {
+            uint16_t i = Flash_kv_job.position++;
+            if (!Flash_program_halfword(Flash_kv_job.address + i * 2, Flash_kv_cursor_halfword(i)))
+            {
+                Flash_kv_job_finish(false);
+                return;
+            }
+        }
+        if (Flash_kv_job.position < Flash_kv_job.count)
+            break;
+        if (!Flash_kv_job.compacting)
+        {
+            Flash_kv_index[Flash_kv_queue[0].key] = Flash_kv_job.offset;
+            Flash_kv_job_finish(true);
+        }
+        else if (Flash_kv_job.copy_key > FLASH_KV_MAX_KEYS)
+        {
+            Flash_kv_job.state = Flash_kv_job_state::header;
+        }
+        else
+        {
+            Flash_kv_job.state = Flash_kv_job_state::copy;
+        }
+        break;
+    }
+    case Flash_kv_job_state::header:
+    {
+        // Header last: until it is complete the previous page stays authoritative
+        uint32_t base = Flash_kv_page_address(Flash_kv_job.target);
+        uint16_t seq = Flash_kv_seq + 1;
+        if (!(Flash_program_halfword(base + 4, seq) && Flash_program_halfword(base + 6, (uint16_t)~seq) &&
+              Flash_program_halfword(base, FLASH_KV_MAGIC & 0xFFFF) &&
+              Flash_program_halfword(base + 2, FLASH_KV_MAGIC >> 16)))
+        {
+            Flash_kv_job_finish(false);
+            break;
+        }
+        Flash_kv_active = Flash_kv_job.target;
+        Flash_kv_seq = seq;
+        Flash_kv_write_offset = Flash_kv_job.offset;
+        memcpy(Flash_kv_index, Flash_kv_job.new_index, sizeof(Flash_kv_index));
+        Flash_kv_job_finish(true);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/**
+ * Queue a value for writing. The value is copied, so the caller's buffer
+ * may change or go out of scope immediately. A value already queued for the
+ * same key is replaced; unchanged values are dropped when the job starts.
+ * @return false if the value is too large or the queue is full
+ */
+bool Flash_kv_write(uint8_t key, uint8_t version, const void *data, uint16_t length)
+{
+    if ((key >= FLASH_KV_MAX_KEYS) || (length > FLASH_KV_MAX_VALUE))
+        return false;
+
+    // The head slot is owned by a running job and must not change under it
+    int first = (Flash_kv_job.state == Flash_kv_job_state::idle) ? 0 : 1;
+    Flash_kv_pending *slot = NULL;
+    for (int i = first; i < Flash_kv_queue_count; i++)
+    {
+        if (Flash_kv_queue[i].key == key)
+        {
+            slot = &Flash_kv_queue[i];
+            break;
+        }
+    }
+    if (slot == NULL)
+    {
+        if (Flash_kv_queue_count >= FLASH_KV_QUEUE_SIZE)
+        {
+            LOG_MY(FLASH, WARN, "Flash_kv queue full\n");
+            return false;
+        }
+        slot = &Flash_kv_queue[Flash_kv_queue_count++];
+    }
+    slot->key = key;
+    slot->version = version;
+    slot->length = length;
+    memcpy(slot->data, data, length);
+    return true;
+}
+
+/**
+ * @return true while writes are queued or in progress
+ */
+bool Flash_kv_busy()
+{
+    return Flash_kv_queue_count != 0;
+}
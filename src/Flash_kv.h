@@ -0,0 +1,46 @@
+#pragma once
+
+#include "config.h"
+#include <stdint.h>
+
+/**
+ * Append-only key/value log in flash
+ *
+ * Records are appended to the active page and never rewritten in place. Each
+ * record carries its key, a schema version and a CRC32 trailer, so a write torn
+ * by a brown-out is simply ignored on the next boot and the previous value wins.
+ * When the active page is full the latest record of every key is copied to
+ * the other page, which only becomes active once its header is written; the
+ * old page stays intact until the next compaction, giving an A/B pair where
+ * boot always picks the newest page with a valid header.
+ *
+ * Writes are queued and carried out in small steps by Flash_kv_run() from the
+ * main loop, so saving never stalls the bus.
+ */
+
+/**
+ * Key identifiers - keep them stable, they are stored in flash
+ */
+enum Flash_kv_key
+{
+    FLASH_KV_KEY_MOTION_DIR = 0x01, ///< Motor directions and auto-learn flags
+    FLASH_KV_KEY_BUS_STATE = 0x02,  ///< Selected filament channel
+    FLASH_KV_KEY_TUNING = 0x03,     ///< Control gains and thresholds set from the console
+    FLASH_KV_KEY_MOTOR_MODEL = 0x04, ///< Identified per-channel motor model
+    FLASH_KV_KEY_SPEED_GAINS = 0x05, ///< Auto-tuned per-channel speed loop gains
+    FLASH_KV_KEY_PRESSURE_GAINS = 0x06, ///< Auto-tuned per-channel pressure loop gains
+    FLASH_KV_KEY_FILAMENT = 0x10,   ///< Filament profile, one key per channel (0x10..0x13)
+};
+
+// A queued write replaces the one already waiting for its key, so the queue
+// never holds more than one write per key besides the one being programmed
+#define FLASH_KV_KEYS_IN_USE (FLASH_KV_KEY_PRESSURE_GAINS - FLASH_KV_KEY_MOTION_DIR + 1 + MAX_FILAMENT_CHANNELS)
+static_assert(FLASH_KV_QUEUE_SIZE >= FLASH_KV_KEYS_IN_USE + 1, "FLASH_KV_QUEUE_SIZE must hold every key in use");
+
+extern void Flash_kv_init();
+extern const void *Flash_kv_find(uint8_t key, uint8_t *version, uint16_t *length);
+extern const void *Flash_kv_map_address(uint32_t address);
+extern bool Flash_kv_read(uint8_t key, uint8_t version, void *buf, uint16_t length);
+extern bool Flash_kv_write(uint8_t key, uint8_t version, const void *data, uint16_t length);
+extern void Flash_kv_run(bool bus_idle);
+extern bool Flash_kv_busy();
@@ -25,59 +25,123 @@ volatile TestStatus MemoryEraseStatus = PASSED;
 u32 buf[Fsize];
 
 /*********************************************************************
- * @fn      Flash_Test
+ * @fn      Flash_write_begin / Flash_write_end
  *
- * @brief   Flash Program Test.
+ * @brief   Unlock the flash controller for a batch of erase/program operations.
+ */
+void Flash_write_begin()
+{
+    FLASH_Unlock();
+    FLASH_ClearFlag(FLASH_FLAG_BSY | FLASH_FLAG_EOP | FLASH_FLAG_WRPRTERR);
+}
+
+void Flash_write_end()
+{
+    FLASH_Lock();
+}
+
+/*********************************************************************
+ * @fn      Flash_erase_page
+ *
+ * @brief   Erase one 4KB page. Interrupts stay enabled: the erase itself is
+ *          what takes time, masking the bus RX interrupt would only lose bytes.
+ *
+ * @return  true if the page erased cleanly
+ */
+bool Flash_erase_page(uint32_t address)
+{
+    FLASHStatus = FLASH_ErasePage(address);
+    return FLASHStatus == FLASH_COMPLETE;
+}
+
+/*********************************************************************
+ * @fn      Flash_program_halfword
  *
- * @return  none
+ * @brief   Program a single half-word. This is the only place interrupts
+ *          are masked, so the worst-case masked window is one program cycle.
+ *          With FLASH_VERIFY_WRITES the half-word is read back afterwards.
+ *
+ * @return  true if the half-word was programmed (and reads back correctly)
+ */
+uint32_t Flash_irq_masked_max_us = 0; // worst-case interrupt-masked window observed
+
+bool Flash_program_halfword(uint32_t address, uint16_t data)
+{
+    __disable_irq(); // 禁用中断
+    uint32_t start = micros();
+    FLASHStatus = FLASH_ProgramHalfWord(address, data);
+    uint32_t masked_us = micros() - start;
+    __enable_irq();
+    if (masked_us > Flash_irq_masked_max_us)
+        Flash_irq_masked_max_us = masked_us;
+    if (FLASHStatus != FLASH_COMPLETE)
+        return false;
+#if FLASH_VERIFY_WRITES
+    if (*(__IO uint16_t *)address != data)
+    {
+        MemoryProgramStatus = FAILED;
+        return false;
+    }
+#endif
+    return true;
+}
+
+/*********************************************************************
+ * @fn      Flash_get_irq_masked_max_us
+ *
+ * @return  longest time interrupts were masked by a flash program, in us
+ */
+uint32_t Flash_get_irq_masked_max_us()
+{
+    return Flash_irq_masked_max_us;
+}
+
+/*********************************************************************
+ * @fn      Flash_saves
+ *
+ * @brief   Erase every page covered by [address, address + length) and
+ *          program buf into it.
+ *
+ * @return  true if every erase and program step completed and the
+ *          programmed data reads back unchanged
  */
 bool Flash_saves(void *buf, uint32_t length, uint32_t address)
 {
     uint32_t end_address = address + length;
-    uint32_t erase_counter = 0;
     uint32_t address_i = 0;
-    uint32_t page_num = length / FLASH_PAGE_SIZE;
+    uint32_t page_num = (length + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE; // 不足一页也要擦除
     uint16_t *data_ptr = (uint16_t *)buf;
+    bool ok = true;
 
-    __disable_irq(); // 禁用中断
-    FLASH_Unlock();
+    Flash_write_begin();
 
-    FLASH_ClearFlag(FLASH_FLAG_BSY | FLASH_FLAG_EOP | FLASH_FLAG_WRPRTERR);
-
-    for (erase_counter = 0; (erase_counter < page_num) && (FLASHStatus == FLASH_COMPLETE); erase_counter++)
+    for (uint32_t erase_counter = 0; ok && (erase_counter < page_num); erase_counter++)
     {
-        FLASHStatus = FLASH_ErasePage(address + (FLASH_PAGE_SIZE * erase_counter)); // Erase 4KB
-
-        if (FLASHStatus != FLASH_COMPLETE)
-            return false;
+        ok = Flash_erase_page(address + (FLASH_PAGE_SIZE * erase_counter)); // Erase 4KB
     }
 
     address_i = address;
-    while ((address_i < end_address) && (FLASHStatus == FLASH_COMPLETE))
+    while (ok && (address_i < end_address))
     {
-        FLASHStatus = FLASH_ProgramHalfWord(address_i, *data_ptr);
+        ok = Flash_program_halfword(address_i, *data_ptr);
         address_i = address_i + 2;
         data_ptr++;
     }
 
-    FLASH_Lock();
-    __enable_irq();
-    /*
-        address_i = address;
-        data_ptr=(uint16_t *)buf;
-        while ((address_i < end_address) && (MemoryProgramStatus != FAILED))
+    Flash_write_end();
+
+    // 回读校验，编程状态正常也可能因掉电或磨损而数据不符
+    address_i = address;
+    data_ptr = (uint16_t *)buf;
+    while (ok && (address_i < end_address))
+    {
+        if ((*(__IO uint16_t *)address_i) != *data_ptr)
         {
-            if ((*(__IO uint16_t *)address_i) != *data_ptr)
-            {
-                MemoryProgramStatus = FAILED;
-            }
-            address_i += 2;
-            data_ptr++;
+            MemoryProgramStatus = FAILED;
+            ok = false;
         }
-
-        if (MemoryProgramStatus == FAILED)
-            return false;
-        else
-            return true;*/
-    return true;
-}
\ No newline at end of file
+        address_i += 2;
+        data_ptr++;
+    }
+    return ok;
+}
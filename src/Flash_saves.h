@@ -6,4 +6,14 @@
 
 #define FLASH_PAGE_SIZE 4096
 
-extern bool Flash_saves(void *buf, uint32_t length, uint32_t address);
\ No newline at end of file
+extern bool Flash_saves(void *buf, uint32_t length, uint32_t address);
+
+/**
+ * Low-level flash primitives shared by Flash_saves() and the key/value log
+ * Interrupts are only masked around a single half-word program, never around an erase.
+ */
+extern void Flash_write_begin();
+extern void Flash_write_end();
+extern bool Flash_erase_page(uint32_t address);
+extern bool Flash_program_halfword(uint32_t address, uint16_t data);
+extern uint32_t Flash_get_irq_masked_max_us();
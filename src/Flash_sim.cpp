@@ -0,0 +1,118 @@
+#ifndef ARDUINO_ARCH_CH32
+
+#include "Flash_sim.h"
+
+#define FLASH_SIM_SIZE (FLASH_KV_PAGE_COUNT * FLASH_PAGE_SIZE)
+
+uint8_t Flash_sim_memory[FLASH_SIM_SIZE];
+uint32_t Flash_sim_count = 0;      // erases and programs so far
+uint32_t Flash_sim_cut_at = 0;     // operation that loses power, 0 = never
+uint32_t Flash_sim_random = 1;
+
+static uint32_t Flash_sim_next_random()
+{
+    Flash_sim_random ^= Flash_sim_random << 13; // xorshift32
+    Flash_sim_random ^= Flash_sim_random >> 17;
+    Flash_sim_random ^= Flash_sim_random << 5;
+    return Flash_sim_random;
+}
+
+static uint32_t Flash_sim_offset(uint32_t address, uint32_t size)
+{
+    if ((address < FLASH_KV_BASE_ADDRESS) || (address - FLASH_KV_BASE_ADDRESS + size > FLASH_SIM_SIZE))
+        throw "flash access outside the simulated pages";
+    return address - FLASH_KV_BASE_ADDRESS;
+}
+
+// True when this operation is the one cut short by the power loss
+static bool Flash_sim_cut_now()
+{
+    Flash_sim_count++;
+    return (Flash_sim_cut_at != 0) && (Flash_sim_count == Flash_sim_cut_at);
+}
+
+void Flash_write_begin()
+{
+}
+
+void Flash_write_end()
+{
+}
+
+bool Flash_erase_page(uint32_t address)
+{
+    if (address % FLASH_PAGE_SIZE)
+        return false;
+    uint8_t *page = &Flash_sim_memory[Flash_sim_offset(address, FLASH_PAGE_SIZE)];
+    if (Flash_sim_cut_now())
+    {
+        // 擦除中断电: 只有部分字节被擦除
+        for (uint32_t i = 0; i < FLASH_PAGE_SIZE; i++)
+        {
+            if (Flash_sim_next_random() & 1)
+                page[i] = 0xFF;
+        }
+        throw Flash_sim_power_loss();
+    }
+    memset(page, 0xFF, FLASH_PAGE_SIZE);
+    return true;
+}
+
+bool Flash_program_halfword(uint32_t address, uint16_t data)
+{
+    if (address & 1)
+        return false;
+    uint8_t *cell = &Flash_sim_memory[Flash_sim_offset(address, 2)];
+    uint16_t old = cell[0] | (cell[1] << 8);
+    if (old != 0xFFFF) // 和芯片一样, 只能写已擦除的半字
+        return false;
+    if (Flash_sim_cut_now())
+    {
+        // 编程中断电: 只有部分该清零的位被清零
+        data |= (uint16_t)Flash_sim_next_random();
+    }
+    cell[0] = data & 0xFF;
+    cell[1] = data >> 8;
+    if (Flash_sim_count == Flash_sim_cut_at)
+        throw Flash_sim_power_loss();
+    return true;
+}
+
+uint32_t Flash_get_irq_masked_max_us()
+{
+    return 0;
+}
+
+/**
+ * Host pointer to simulated flash, for the in-place reads the target does by address
+ */
+const uint8_t *Flash_sim_map(uint32_t address)
+{
+    return &Flash_sim_memory[Flash_sim_offset(address, 0)];
+}
+
+/**
+ * Start from a blank part and disarm any pending power cut
+ */
+void Flash_sim_erase_all()
+{
+    memset(Flash_sim_memory, 0xFF, sizeof(Flash_sim_memory));
+    Flash_sim_cut_at = 0;
+}
+
+/**
+ * Lose power during the operations-th erase or program from now (0 disarms)
+ * @param seed decides which bits of the interrupted operation get through
+ */
+void Flash_sim_cut_after(uint32_t operations, uint32_t seed)
+{
+    Flash_sim_cut_at = operations ? Flash_sim_count + operations : 0;
+    Flash_sim_random = seed ? seed : 1;
+}
+
+uint32_t Flash_sim_operations()
+{
+    return Flash_sim_count;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Host.h"
+
+/**
+ * Simulated flash for host builds
+ *
+ * Stands in for the Flash_saves.h primitives over a RAM copy of the
+ * FLASH_KV_PAGE_COUNT pages at FLASH_KV_BASE_ADDRESS, with the same rules as
+ * the CH32 flash: erase sets a page to 0xFF, programming can only target an
+ * erased half-word. Flash_sim_cut_after(n) makes the n-th following erase or
+ * program the last one before a power loss: it is left half done and
+ * Flash_sim_power_loss is thrown, so a test can "reboot" and check what the
+ * log recovers.
+ */
+#define FLASH_PAGE_SIZE 4096
+
+struct Flash_sim_power_loss
+{
+};
+
+extern void Flash_write_begin();
+extern void Flash_write_end();
+extern bool Flash_erase_page(uint32_t address);
+extern bool Flash_program_halfword(uint32_t address, uint16_t data);
+extern uint32_t Flash_get_irq_masked_max_us();
+
+extern const uint8_t *Flash_sim_map(uint32_t address);
+extern void Flash_sim_erase_all();
+extern void Flash_sim_cut_after(uint32_t operations, uint32_t seed);
+extern uint32_t Flash_sim_operations();
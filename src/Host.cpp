@@ -0,0 +1,46 @@
+#ifndef ARDUINO_ARCH_CH32
+
+#include "Host.h"
+
+uint32_t Host_time_us = 0;
+
+uint32_t micros()
+{
+    return Host_time_us;
+}
+
+uint32_t millis()
+{
+    return Host_time_us / 1000;
+}
+
+void Host_set_time_us(uint32_t time_us)
+{
+    Host_time_us = time_us;
+}
+
+char Host_output_buf[2048];
+uint32_t Host_output_len = 0;
+
+void Host_print(const char *text)
+{
+    uint32_t len = strlen(text);
+    if (len > sizeof(Host_output_buf) - 1 - Host_output_len) // 满了就截断
+        len = sizeof(Host_output_buf) - 1 - Host_output_len;
+    memcpy(&Host_output_buf[Host_output_len], text, len);
+    Host_output_len += len;
+    Host_output_buf[Host_output_len] = 0;
+}
+
+const char *Host_output()
+{
+    return Host_output_buf;
+}
+
+void Host_output_clear()
+{
+    Host_output_len = 0;
+    Host_output_buf[0] = 0;
+}
+
+#endif
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "config.h"
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Stand-ins for the target headers when a module is compiled on a PC
+ *
+ * Modules that can run off the target (Flash_kv, Boot, Profile) include
+ * main.h only under ARDUINO_ARCH_CH32 and this header otherwise. The host
+ * build ([env:native] in platformio.ini) links them with Host.cpp and
+ * Flash_sim.cpp and runs the tests under test/. [env:native_boot] builds the
+ * rest of the firmware too, against the simulated CH32 in test/test_boot/sim.
+ */
+#ifdef ARDUINO_ARCH_CH32
+#error "Host.h is only for host builds"
+#endif
+
+// Logging and tracing compile away; the tests check state, not output
+#define LOG_IF(module, level) if constexpr (false)
+#define LOG_MY(module, level, logs) do {} while(0)
+#define DEBUG_MY(logs) do {} while(0)
+#define DEBUG_float(logs, precision) do {} while(0)
+#define TRACE(event, ...) do {} while(0)
+
+/**
+ * Simulated clock, advanced by the test instead of by time
+ */
+extern uint32_t micros();
+extern uint32_t millis();
+extern void Host_set_time_us(uint32_t time_us);
+
+/**
+ * Captured console output (Profile_dump), so a test can compare the text
+ */
+extern void Host_print(const char *text);
+extern const char *Host_output();
+extern void Host_output_clear();
+
+/**
+ * Bitwise CRC-32 with the interface of the CRC32 class from robtillaart/CRC,
+ * which needs Arduino.h; only the members Flash_kv uses
+ */
+class CRC32
+{
+    uint32_t polynome = 0x04C11DB7;
+    uint32_t initial = 0xFFFFFFFF;
+    uint32_t xor_out = 0xFFFFFFFF;
+    bool reverse_in = true;
+    bool reverse_out = true;
+    uint32_t crc = 0xFFFFFFFF;
+
+    static uint32_t reverse(uint32_t value, int bits)
+    {
+        uint32_t result = 0;
+        for (int i = 0; i < bits; i++)
+        {
+            result = (result << 1) | (value & 1);
+            value >>= 1;
+        }
+        return result;
+    }
+
+public:
+    void reset(uint32_t _polynome, uint32_t _initial, uint32_t _xor_out, bool _reverse_in, bool _reverse_out)
+    {
+        polynome = _polynome;
+        initial = _initial;
+        xor_out = _xor_out;
+        reverse_in = _reverse_in;
+        reverse_out = _reverse_out;
+        restart();
+    }
+    void restart()
+    {
+        crc = initial;
+    }
+    void add(uint8_t value)
+    {
+        if (reverse_in)
+            value = reverse(value, 8);
+        crc ^= (uint32_t)value << 24;
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 0x80000000UL) ? (crc << 1) ^ polynome : crc << 1;
+    }
+    uint32_t calc()
+    {
+        return (reverse_out ? reverse(crc, 32) : crc) ^ xor_out;
+    }
+};
@@ -0,0 +1,195 @@
+#include "LED_anim.h"
+
+#define LED_ANIM_LEDS 2 // status LED and pull-online LED per channel
+
+/*
+ * Easing tables, generated at compile time. Each maps 0..LED_EASE_STEPS to
+ * 0..255 and is interpolated linearly between entries.
+ */
+#define LED_EASE_STEPS 32
+enum LED_ease
+{
+    LED_EASE_LINEAR,
+    LED_EASE_IN_OUT, // smoothstep
+    LED_EASE_TABLES,
+    LED_EASE_STEP = LED_EASE_TABLES // hold the start value until the next keyframe
+};
+struct LED_ease_table
+{
+    uint8_t v[LED_EASE_TABLES][LED_EASE_STEPS + 1];
+    constexpr LED_ease_table() : v()
+    {
+        for (int i = 0; i <= LED_EASE_STEPS; i++)
+        {
+            int x = i * 255 / LED_EASE_STEPS;
+            v[LED_EASE_LINEAR][i] = x;
+            v[LED_EASE_IN_OUT][i] = (x * x * (3 * 255 - 2 * x) + 255 * 255 / 2) / (255 * 255);
+        }
+    }
+};
+constexpr LED_ease_table LED_ease_lut;
+
+uint8_t LED_ease_apply(uint8_t ease, uint8_t x)
+{
+    if (ease >= LED_EASE_TABLES)
+        return (x == 255) ? 255 : 0;
+    const uint8_t *lut = LED_ease_lut.v[ease];
+    uint16_t pos = x * LED_EASE_STEPS;
+    uint8_t i = pos / 255;
+    uint8_t frac = pos % 255;
+    if (i >= LED_EASE_STEPS)
+        return lut[LED_EASE_STEPS];
+    return lut[i] + ((lut[i + 1] - lut[i]) * frac) / 255;
+}
+
+/*
+ * Keyframes: at = position in the period, mix = blend from color A (0) to
+ * color B (255), ease = curve used to reach the next keyframe.
+ */
+struct LED_keyframe
+{
+    uint8_t at;
+    uint8_t mix;
+    uint8_t ease;
+};
+struct LED_pattern_def
+{
+    const LED_keyframe *frames;
+    uint8_t count;
+    uint16_t period_ms; // 0 = static
+};
+const LED_keyframe LED_frames_solid[] = {{0, 0, LED_EASE_STEP}};
+const LED_keyframe LED_frames_breathe[] = {{0, 0, LED_EASE_IN_OUT}, {128, 255, LED_EASE_IN_OUT}, {255, 0, LED_EASE_STEP}};
+const LED_keyframe LED_frames_blink[] = {{0, 0, LED_EASE_STEP}, {128, 255, LED_EASE_STEP}, {255, 255, LED_EASE_STEP}};
+const LED_pattern_def LED_patterns[LED_PATTERN_COUNT] = {
+    {LED_frames_solid, 1, 0},     // LED_PATTERN_SOLID
+    {LED_frames_breathe, 3, 2000}, // LED_PATTERN_BREATHE
+    {LED_frames_blink, 3, 500},    // LED_PATTERN_BLINK
+    {LED_frames_solid, 1, 0},     // LED_PATTERN_PROGRESS, mix comes from the posted progress
+};
+
+struct LED_layer_state
+{
+    bool active;
+    uint8_t pattern;
+    uint8_t progress;
+    uint32_t color_a;
+    uint32_t color_b;
+    uint32_t start_time;
+};
+LED_layer_state LED_anim_layers[MAX_FILAMENT_CHANNELS][LED_ANIM_LEDS][LED_LAYER_COUNT];
+uint8_t LED_anim_dirty[MAX_FILAMENT_CHANNELS]; // bit per LED: top layer changed, render on next run
+
+static inline bool LED_anim_valid(uint8_t channel, int num)
+{
+    return (channel < MAX_FILAMENT_CHANNELS) && (num >= 0) && (num < LED_ANIM_LEDS);
+}
+
+/**
+ * Post what a LED should show on a layer. Posting the same state again is
+ * a no-op, so it is safe to call on every pass of the control loop.
+ */
+void LED_anim_post(uint8_t channel, int num, LED_layer layer, LED_pattern pattern, uint32_t color_a, uint32_t color_b)
+{
+    if (!LED_anim_valid(channel, num))
+        return;
+    LED_layer_state *s = &LED_anim_layers[channel][num][layer];
+    if (s->active && (s->pattern == pattern) && (s->color_a == color_a) && (s->color_b == color_b))
+        return;
+    if (!s->active || (s->pattern != pattern))
+    {
+        s->start_time = get_time64();
+        s->progress = 0;
+    }
+    s->active = true;
+    s->pattern = pattern;
+    s->color_a = color_a;
+    s->color_b = color_b;
+    LED_anim_dirty[channel] |= 1 << num;
+}
+
+/**
+ * Update the blend of a LED_PATTERN_PROGRESS layer, 0 = color A, 255 = color B
+ */
+void LED_anim_progress(uint8_t channel, int num, uint8_t progress)
+{
+    if (!LED_anim_valid(channel, num))
+        return;
+    LED_layer_state *s = &LED_anim_layers[channel][num][LED_LAYER_PROGRESS];
+    if (s->progress == progress)
+        return;
+    s->progress = progress;
+    LED_anim_dirty[channel] |= 1 << num;
+}
+
+/**
+ * Remove a layer so the one below shows through
+ */
+void LED_anim_clear(uint8_t channel, int num, LED_layer layer)
+{
+    if (!LED_anim_valid(channel, num) || !LED_anim_layers[channel][num][layer].active)
+        return;
+    LED_anim_layers[channel][num][layer].active = false;
+    LED_anim_dirty[channel] |= 1 << num;
+}
+
+static inline uint8_t LED_anim_blend(uint32_t a, uint32_t b, int shift, uint8_t mix)
+{
+    int ca = (a >> shift) & 0xFF;
+    int diff = (int)((b >> shift) & 0xFF) - ca;
+    return ca + (diff * mix + (diff < 0 ? -127 : 127)) / 255; // round to nearest either way
+}
+
+// Blend factor of a pattern at a given time
+uint8_t LED_anim_mix(const LED_layer_state *s, uint32_t now)
+{
+    if (s->pattern == LED_PATTERN_PROGRESS)
+        return s->progress;
+    const LED_pattern_def *def = &LED_patterns[s->pattern];
+    if ((def->period_ms == 0) || (def->count < 2))
+        return def->frames[0].mix;
+
+    uint8_t phase = ((now - s->start_time) % def->period_ms) * 256 / def->period_ms;
+    int k = 0;
+    while ((k + 2 < def->count) && (phase >= def->frames[k + 1].at))
+        k++;
+    const LED_keyframe *from = &def->frames[k];
+    const LED_keyframe *to = &def->frames[k + 1];
+    uint8_t t = (phase - from->at) * 255 / (to->at - from->at);
+    int eased = LED_ease_apply(from->ease, t);
+    return from->mix + ((to->mix - from->mix) * eased) / 255;
+}
+
+/**
+ * Render every LED whose top layer changed or is animated.
+ * Called once per main loop pass; Set_MC_RGB() drops unchanged colors.
+ */
+void LED_anim_run()
+{
+    static uint64_t last_time = 0;
+    uint64_t now = get_time64();
+    bool tick = (now - last_time) >= 1000 / LED_REFRESH_HZ; // animated layers advance at the LED frame rate
+    if (tick)
+        last_time = now;
+
+    for (int channel = 0; channel < MAX_FILAMENT_CHANNELS; channel++)
+    {
+        for (int num = 0; num < LED_ANIM_LEDS; num++)
+        {
+            int layer = LED_LAYER_COUNT - 1;
+            while ((layer >= 0) && !LED_anim_layers[channel][num][layer].active)
+                layer--;
+            if (layer < 0)
+                continue;
+            const LED_layer_state *s = &LED_anim_layers[channel][num][layer];
+            bool animated = LED_patterns[s->pattern].period_ms != 0;
+            if (!(LED_anim_dirty[channel] & (1 << num)) && !(animated && tick))
+                continue;
+
+            uint8_t mix = LED_anim_mix(s, now);
+            Set_MC_RGB(channel, num, LED_anim_blend(s->color_a, s->color_b, 16, mix),
+                       LED_anim_blend(s->color_a, s->color_b, 8, mix), LED_anim_blend(s->color_a, s->color_b, 0, mix));
+        }
+        LED_anim_dirty[channel] = 0;
+    }
+}
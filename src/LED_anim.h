@@ -0,0 +1,41 @@
+#pragma once
+#include "main.h"
+
+/**
+ * Declarative LED animation engine for the channel LEDs
+ *
+ * Control code posts what a LED should show on one of its layers; the
+ * highest active layer wins (error over progress over idle). LED_anim_run()
+ * renders the result from the main loop, only for LEDs whose layer changed
+ * or whose pattern is time-varying, and hands it to Set_MC_RGB().
+ */
+enum LED_layer
+{
+    LED_LAYER_IDLE,     ///< Normal channel state colors
+    LED_LAYER_PROGRESS, ///< Feed/retract progress
+    LED_LAYER_ERROR,    ///< Faults, always on top
+    LED_LAYER_COUNT
+};
+
+enum LED_pattern
+{
+    LED_PATTERN_SOLID,    ///< Color A
+    LED_PATTERN_BREATHE,  ///< Eased fade A -> B -> A
+    LED_PATTERN_BLINK,    ///< Hard switch A / B
+    LED_PATTERN_PROGRESS, ///< A blended towards B by the posted progress
+    LED_PATTERN_COUNT
+};
+
+extern void LED_anim_post(uint8_t channel, int num, LED_layer layer, LED_pattern pattern, uint32_t color_a,
+                          uint32_t color_b = 0);
+extern void LED_anim_progress(uint8_t channel, int num, uint8_t progress);
+extern void LED_anim_clear(uint8_t channel, int num, LED_layer layer);
+extern void LED_anim_run();
+
+/**
+ * Pack a color for LED_anim_post()
+ */
+static inline uint32_t LED_rgb(uint8_t R, uint8_t G, uint8_t B)
+{
+    return ((uint32_t)R << 16) | ((uint32_t)G << 8) | B;
+}
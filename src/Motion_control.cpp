@@ -29,22 +29,54 @@ float MC_ONLINE_key_stu_raw[MAX_FILAMENT_CHANNELS] = {0, 0, 0, 0}; ///< Raw onli
 int MC_ONLINE_key_stu[MAX_FILAMENT_CHANNELS] = {0, 0, 0, 0};
 int MC_ONLINE_key_stu_prev[MAX_FILAMENT_CHANNELS] = {0, 0, 0, 0}; ///< Previous presence sensor state for edge detection
 
-// Voltage control constants (defined in config.h)
-const float PULL_voltage_up = PULL_VOLTAGE_HIGH;     ///< High pressure threshold - red LED
-const float PULL_voltage_down = PULL_VOLTAGE_LOW;    ///< Low pressure threshold - blue LED
-
-// Motion assist variables
-bool Assist_send_filament[MAX_FILAMENT_CHANNELS] = {false, false, false, false};
-bool pull_state_old = false; ///< Previous trigger state - True: not triggered, False: feeding complete
-bool is_backing_out = false;  ///< Currently backing out filament
+// Voltage thresholds and gains are in MC_tuning (config.h defaults, console/flash overrides)
 
 uint64_t Assist_filament_time[MAX_FILAMENT_CHANNELS] = {0, 0, 0, 0};
-const uint64_t Assist_send_time = ASSIST_SEND_TIME_MS; ///< Feed assist duration after outer trigger
 
 // Retraction distances (in millimeters) - defined in config.h
 const float_t P1X_OUT_filament_meters = P1X_OUT_FILAMENT_MM;        ///< Internal retraction distance
 const float_t P1X_OUT_filament_ext_meters = P1X_OUT_FILAMENT_EXT_MM; ///< External retraction distance
-float_t last_total_distance[MAX_FILAMENT_CHANNELS] = {0.0f, 0.0f, 0.0f, 0.0f}; ///< Initial distance when retraction started
+
+enum filament_now_position_enum
+{
+    filament_idle,
+    filament_sending_out,
+    filament_using,
+    filament_pulling_back,
+    filament_redetect,
+};
+
+/**
+ * Filament-change state, one array per field indexed by channel. Nothing here
+ * is shared between channels, so one channel can retract while another loads.
+ */
+struct Motion_channel_state
+{
+    int position[MAX_FILAMENT_CHANNELS];              ///< filament_now_position_enum
+    bool backing_out[MAX_FILAMENT_CHANNELS];          ///< Retracting: accumulate retract_distance
+    float_t retract_distance[MAX_FILAMENT_CHANNELS];  ///< Distance retracted so far (mm)
+    bool first_use[MAX_FILAMENT_CHANNELS];            ///< AMS (P1X) just loaded: don't pull back until the buffer has slackened once
+    uint64_t slow_send_end[MAX_FILAMENT_CHANNELS];    ///< End of the slow feed that helps the extruder grip (ms)
+    bool assist_send[MAX_FILAMENT_CHANNELS];          ///< Feed assist armed, re-armed whenever the channel empties
+    float_t feed_distance[MAX_FILAMENT_CHANNELS];     ///< Distance fed since the channel started sending out (mm)
+};
+Motion_channel_state MC_channel = {};
+
+/**
+ * Filament change planner state. A swap starts when a channel begins to
+ * retract and ends when the next channel reaches the extruder.
+ */
+struct Motion_change_state
+{
+    int from = -1;              ///< Retracting channel, -1 when no swap is in progress
+    uint64_t start_time = 0;    ///< Retraction start (ms)
+    uint64_t feed_time = 0;     ///< Incoming channel started feeding (ms), 0 until then
+    uint64_t retract_time = 0;  ///< Retraction finished (ms), 0 until then
+    uint32_t last_ms = 0;       ///< Duration of the last swap
+    uint32_t last_overlap_ms = 0; ///< Time both channels were moving during the last swap
+    uint32_t count = 0;
+};
+Motion_change_state MC_change;
 
 // Dual micro-switch configuration
 const bool is_two = false; ///< Use dual micro-switches
@@ -54,6 +86,9 @@ const bool is_two = false; ///< Use dual micro-switches
  */
 void MC_PULL_ONLINE_read()
 {
+    if (!ADC_DMA_ready()) // 启动时滤波窗口还没填满，保持之前的状态
+        return;
+    Boot_mark(BOOT_ADC_READY);
     float *data = ADC_DMA_get_value();
     
     // Store previous presence sensor states for edge detection
@@ -74,22 +109,11 @@ void MC_PULL_ONLINE_read()
     // Process sensor readings for each channel
     for (int i = 0; i < MAX_FILAMENT_CHANNELS; i++)
     {
-        /*
-        if (i == 0){
-            DEBUG_MY("MC_PULL_stu_raw = ");
-            DEBUG_float(MC_PULL_stu_raw[i],3);
-            DEBUG_MY("  MC_ONLINE_key_stu_raw = ");
-            DEBUG_float(MC_ONLINE_key_stu_raw[i],3);
-            DEBUG_MY("  通道：");
-            DEBUG_float(i,1);
-            DEBUG_MY("   \n");
-        }
-        */
-        if (MC_PULL_stu_raw[i] > PULL_voltage_up) // 大于1.85V,表示压力过高
+        if (MC_PULL_stu_raw[i] > MC_tuning.pull_voltage_high) // 大于1.85V,表示压力过高
         {
             MC_PULL_stu[i] = 1;
         }
-        else if (MC_PULL_stu_raw[i] < PULL_voltage_down) // 小于1.45V，表示压力过低
+        else if (MC_PULL_stu_raw[i] < MC_tuning.pull_voltage_low) // 小于1.45V，表示压力过低
         {
             MC_PULL_stu[i] = -1;
         }
@@ -138,9 +162,12 @@ void MC_PULL_ONLINE_read()
         if (MC_ONLINE_key_stu_prev[i] == 0 && MC_ONLINE_key_stu[i] == 1) {
             // Filament presence detected for the first time - automatically start feeding
             if (get_filament_motion(i) == AMS_filament_motion::idle) {
-                DEBUG_MY("Auto-start feeding for channel ");
-                DEBUG_float(i, 0);
-                DEBUG_MY(" - presence detected\n");
+                LOG_IF(MOTION, INFO)
+                {
+                    DEBUG_MY("Auto-start feeding for channel ");
+                    DEBUG_float(i, 0);
+                    DEBUG_MY(" - presence detected\n");
+                }
                 set_filament_motion(i, AMS_filament_motion::need_send_out);
             }
         }
@@ -189,20 +216,44 @@ struct LoadingDirectionState
     bool presence_stable_phase;    ///< Whether we're in the stable monitoring phase
 } loading_detection[MAX_FILAMENT_CHANNELS];
 
-#define Motion_control_save_flash_addr ((uint32_t)0x0800E000)
+#define Motion_control_save_version 1
+void Motion_control_save();
+#define Motion_control_save_flash_addr ((uint32_t)0x0800E000) // legacy fixed slot, read once for migration
 bool Motion_control_read()
 {
-    Motion_control_save_struct *ptr = (Motion_control_save_struct *)(Motion_control_save_flash_addr);
-    if (ptr->check == 0x40614061)
+    if (Flash_kv_read(FLASH_KV_KEY_MOTION_DIR, Motion_control_save_version, &Motion_control_data_save,
+                      sizeof(Motion_control_save_struct)))
     {
-        memcpy(&Motion_control_data_save, ptr, sizeof(Motion_control_save_struct));
         return true;
     }
-    return false;
+    // The legacy slot only has a magic word, so also reject values a torn write could leave behind
+    const Motion_control_save_struct *ptr =
+        (const Motion_control_save_struct *)Flash_kv_map_address(Motion_control_save_flash_addr);
+    if (ptr->check != 0x40614061)
+        return false;
+    for (int i = 0; i < 4; i++)
+    {
+        int dir = ptr->Motion_control_dir[i];
+        uint8_t learned = *(const uint8_t *)&ptr->auto_learned[i];
+        if ((dir < -1) || (dir > 1) || (learned > 1))
+            return false;
+    }
+    memcpy(&Motion_control_data_save, ptr, sizeof(Motion_control_save_struct));
+    Motion_control_save(); // migrate before the key/value log reclaims the legacy page
+    return true;
 }
+
+// Records whose Flash_kv_write() was refused; see Motion_control_save_pending()
+#define MC_SAVE_DIR (1 << 0)
+#define MC_SAVE_SPEED_GAINS (1 << 1)
+#define MC_SAVE_PRESSURE_GAINS (1 << 2)
+uint8_t MC_save_pending = 0;
+void Motion_control_save_pending();
+
 void Motion_control_save()
 {
-    Flash_saves(&Motion_control_data_save, sizeof(Motion_control_save_struct), Motion_control_save_flash_addr);
+    MC_save_pending |= MC_SAVE_DIR;
+    Motion_control_save_pending();
 }
 
 class MOTOR_PID
@@ -268,6 +319,218 @@ public:
     }
 };
 
+/**
+ * Speed set-point generator. The set-point follows the requested speed with
+ * acceleration limited to MOTION_ACCEL_MM_S2 and, when MOTION_JERK_MM_S3 is
+ * non-zero, acceleration itself ramped (S-curve); with jerk 0 the ramps are
+ * trapezoidal. Given the distance still to go, speed is also capped so the
+ * move brakes down to MOTION_CREEP_SPEED_MM_S exactly at the target.
+ */
+class MOTION_PROFILE
+{
+    float v = 0; // 当前速度设定, mm/s
+    float a = 0; // 当前加速度, mm/s^2
+
+public:
+    void reset(float speed)
+    {
+        v = speed;
+        a = 0;
+    }
+    /**
+     * @param target       requested speed (mm/s, signed)
+     * @param distance_left distance to the end of the move (mm), negative when open-ended
+     * @param time_E       time since the last call (s)
+     * @return the speed set-point for this step
+     */
+    float update(float target, float distance_left, float time_E)
+    {
+        if (time_E > 0.1f) // 长时间没有调用, 不要一步跳过去
+            time_E = 0.1f;
+        float v_brake = -1;
+        if (distance_left >= 0)
+        {
+            v_brake = sqrtf(MOTION_CREEP_SPEED_MM_S * MOTION_CREEP_SPEED_MM_S + 2 * MOTION_ACCEL_MM_S2 * distance_left);
+            if (target > v_brake)
+                target = v_brake;
+            else if (target < -v_brake)
+                target = -v_brake;
+        }
+        float error = target - v;
+        // 接近目标时减小加速度, 保证按加加速度限制平滑落到目标速度
+        float a_want = MOTION_ACCEL_MM_S2;
+        if (MOTION_JERK_MM_S3 > 0)
+            a_want = fminf(a_want, sqrtf(2 * MOTION_JERK_MM_S3 * fabsf(error)));
+        if (error < 0)
+            a_want = -a_want;
+        if (MOTION_JERK_MM_S3 > 0)
+        {
+            float da = MOTION_JERK_MM_S3 * time_E;
+            a = (a_want > a + da) ? a + da : (a_want < a - da) ? a - da : a_want;
+        }
+        else
+        {
+            a = a_want;
+        }
+        v += a * time_E;
+        if ((error > 0) ? (v >= target) : (v <= target)) // 到达目标速度
+        {
+            v = target;
+            a = 0;
+        }
+        if ((v_brake >= 0) && (fabsf(v) > v_brake)) // 减速段直接沿制动曲线走, 保证在终点前降到蠕动速度
+        {
+            v = (v > 0) ? v_brake : -v_brake;
+            a = 0;
+        }
+        return v;
+    }
+};
+
+/**
+ * Buffer controller for the AMS lite in-use mode. Everything fed into the buffer is
+ * either still in it or has been drawn by the extruder, so
+ *   extrusion rate = feed speed (AS5600) - buffer voltage slope * mm per volt,
+ * with mm per volt from MC_tuning.buffer_mm_per_v (default BUFFER_MM_PER_V).
+ * The feed speed is set to that estimate plus a term that brings the buffer
+ * back to the middle of the target band within BUFFER_CENTER_TIME_S, so a
+ * rising extrusion rate is followed before the buffer runs empty.
+ */
+class BUFFER_CONTROL
+{
+    float voltage = 0; // 滤波后的缓冲电压
+    float rate = 0;    // 挤出速度估计, mm/s
+    float target = 0;  // 当前目标电压, 从进入时的电压缓慢移到中点
+
+public:
+    void reset(float _voltage)
+    {
+        voltage = _voltage;
+        rate = 0;
+        target = _voltage; // 刚进入使用时不回拉, 目标从当前位置慢慢回到中点
+    }
+    float get_rate()
+    {
+        return rate;
+    }
+    /**
+     * @param raw        buffer voltage (V)
+     * @param feed_speed measured feed speed (mm/s, >0 into the buffer)
+     * @param centre     voltage to hold the buffer at
+     * @param time_E     time since the last call (s)
+     * @return the feed speed set-point (mm/s)
+     */
+    float update(float raw, float feed_speed, float centre, float time_E)
+    {
+        if ((time_E <= 0) || (time_E > 0.1f))
+            return 0;
+        float last = voltage;
+        voltage += (raw - voltage) * time_E / (BUFFER_VOLTAGE_FILTER_S + time_E);
+        float extrusion = feed_speed - (voltage - last) / time_E * MC_tuning.buffer_mm_per_v;
+        rate += (extrusion - rate) * time_E / (BUFFER_RATE_FILTER_S + time_E);
+
+        float step = BUFFER_TARGET_SLEW_V_S * time_E;
+        target += (centre - target > step) ? step : (centre - target < -step) ? -step : centre - target;
+
+        float speed_set = rate + (target - voltage) * MC_tuning.buffer_mm_per_v / BUFFER_CENTER_TIME_S;
+        if (speed_set > BUFFER_MAX_FEED_MM_S)
+            speed_set = BUFFER_MAX_FEED_MM_S;
+        else if (speed_set < -BUFFER_MAX_RETRACT_MM_S)
+            speed_set = -BUFFER_MAX_RETRACT_MM_S;
+        if (fabsf(speed_set) < BUFFER_MIN_SPEED_MM_S) // 打印机没在挤出, 不要让电机抖动
+            speed_set = 0;
+        return speed_set;
+    }
+};
+
+/**
+ * Per-channel motor model, |PWM| needed to turn at speed v (mm/s):
+ *   from rest: breakaway
+ *   turning:   offset + gain * |v|
+ * Identified online from the speed loop and stored in flash, so the speed
+ * loop can feed the model forward and PID only trims the residual.
+ * Stored as one record, so only append fields and bump the version.
+ */
+struct Motor_model_save_struct
+{
+    float breakaway[MAX_FILAMENT_CHANNELS]; ///< Static friction: |PWM| at which a stopped motor starts to turn
+    float offset[MAX_FILAMENT_CHANNELS];    ///< Kinetic friction: |PWM| intercept while turning
+    float gain[MAX_FILAMENT_CHANNELS];      ///< Viscous term: |PWM| per mm/s
+    uint8_t valid[MAX_FILAMENT_CHANNELS];
+};
+#define Motor_model_version 1
+static_assert(sizeof(Motor_model_save_struct) <= FLASH_KV_MAX_VALUE, "motor model does not fit in one flash record");
+Motor_model_save_struct MC_motor_model = {};
+Motor_model_save_struct MC_motor_model_saved = {};
+uint64_t MC_motor_model_save_time = 0;
+
+/**
+ * Feed-forward |PWM| with the sign of speed_set, 0 while the model is not identified
+ */
+float Motor_model_feedforward(int CHx, float speed_set, float now_speed)
+{
+    if (!MOTOR_MODEL_ENABLED || !MC_motor_model.valid[CHx] || (fabsf(speed_set) < 0.1f))
+        return 0;
+    float pwm = (fabsf(now_speed) < MOTOR_MODEL_STOPPED_MM_S) ? MC_motor_model.breakaway[CHx] : MC_motor_model.offset[CHx];
+    pwm += MC_motor_model.gain[CHx] * fabsf(speed_set);
+    return (speed_set > 0) ? pwm : -pwm;
+}
+
+/**
+ * Exponentially weighted least-squares fit of |PWM| = offset + gain * |v|,
+ * plus a running average of the breakaway PWM
+ */
+class MOTOR_MODEL_FIT
+{
+    float n = 0, sv = 0, sp = 0, svv = 0, svp = 0;
+    float breakaway = 0;
+    int breakaway_n = 0;
+
+public:
+    void clear()
+    {
+        n = sv = sp = svv = svp = breakaway = 0;
+        breakaway_n = 0;
+    }
+    void add(float v, float pwm)
+    {
+        const float k = MOTOR_MODEL_FORGET;
+        n = n * k + 1;
+        sv = sv * k + v;
+        sp = sp * k + pwm;
+        svv = svv * k + v * v;
+        svp = svp * k + v * pwm;
+    }
+    void add_breakaway(float pwm)
+    {
+        breakaway = breakaway_n ? breakaway + (pwm - breakaway) * 0.25f : pwm;
+        breakaway_n++;
+    }
+    /**
+     * @return true and the parameters once enough samples over a wide enough speed range are in
+     */
+    bool solve(float *_breakaway, float *offset, float *gain)
+    {
+        if ((n < MOTOR_MODEL_MIN_SAMPLES) || (breakaway_n < 3))
+            return false;
+        float var = n * svv - sv * sv;
+        if (var < n * n * MOTOR_MODEL_MIN_SPREAD_MM_S * MOTOR_MODEL_MIN_SPREAD_MM_S) // 速度范围太窄, 斜率不可信
+            return false;
+        float g = (n * svp - sv * sp) / var;
+        float c = (sp - g * sv) / n;
+        if ((g <= 0) || (g > PWM_lim / 10) || (c < 0) || (c > PWM_lim))
+            return false;
+        *gain = g;
+        *offset = c;
+        *_breakaway = (breakaway > c) ? breakaway : c;
+        return true;
+    }
+    int samples()
+    {
+        return (int)n;
+    }
+};
+
 enum class filament_motion_enum
 {
     filament_motion_send,
@@ -281,7 +544,6 @@ enum class filament_motion_enum
 enum class pressure_control_enum
 {
     less_pressure,
-    all,
     over_pressure
 };
 
@@ -291,8 +553,13 @@ public:
     filament_motion_enum motion = filament_motion_enum::filament_motion_stop;
     int CHx = 0;
     uint64_t motor_stop_time = 0;
-    MOTOR_PID PID_speed = MOTOR_PID(2, 20, 0);
-    MOTOR_PID PID_pressure = MOTOR_PID(1500, 0, 0);
+    MOTOR_PID PID_speed = MOTOR_PID(MOTOR_SPEED_PID_P, MOTOR_SPEED_PID_I, MOTOR_SPEED_PID_D);
+    MOTOR_PID PID_pressure = MOTOR_PID(MOTOR_PRESSURE_PID_P, MOTOR_PRESSURE_PID_I, MOTOR_PRESSURE_PID_D);
+    MOTION_PROFILE profile;
+    MOTOR_MODEL_FIT model_fit;
+    float model_last_speed = 0; // 上次辨识时的速度, 用来判断刚刚起转
+    BUFFER_CONTROL buffer;
+    float distance_left = -1; // 距离目标的剩余长度(mm), <0 表示不限距离
     float pwm_zero = 500;
     float dir = 0;
     int x1 = 0;
@@ -314,23 +581,62 @@ public:
         if (motion != _motion)
         {
             motion = _motion;
+            TRACE(FILAMENT_MOTION, (uint8_t)CHx, (uint8_t)motion);
             PID_speed.clear();
+            profile.reset(speed_as5600[CHx]); // 从实际速度开始加减速
+            distance_left = -1;
+            buffer.reset(MC_PULL_stu_raw[CHx]);
         }
     }
+    /**
+     * Make the current move end after distance_mm; call again as the distance shrinks
+     */
+    void set_distance_left(float distance_mm)
+    {
+        distance_left = distance_mm;
+    }
     filament_motion_enum get_motion()
     {
         return motion;
     }
+    /**
+     * Feed the model fit with the PWM applied last step and the speed it produced.
+     * Only samples where the motor turns the commanded way and follows the
+     * set-point closely are used, so acceleration barely biases the fit.
+     */
+    void identify_model(float speed_set, float now_speed)
+    {
+        float pwm = -dir * Motion_control_pwm[CHx]; // >0 drives towards positive speed
+        bool was_stopped = fabsf(model_last_speed) < MOTOR_MODEL_STOPPED_MM_S;
+        model_last_speed = now_speed;
+        if ((dir == 0) || (pwm == 0) || ((pwm > 0) != (now_speed > 0)))
+            return;
+        if (was_stopped && (fabsf(now_speed) > 2 * MOTOR_MODEL_STOPPED_MM_S)) // 刚刚起转
+            model_fit.add_breakaway(fabsf(pwm));
+        if ((fabsf(now_speed) >= MOTOR_MODEL_MIN_SPEED_MM_S) && (fabsf(now_speed - speed_set) < 1 + 0.1f * fabsf(speed_set)))
+            model_fit.add(fabsf(now_speed), fabsf(pwm));
+        float breakaway, offset, gain;
+        if (model_fit.solve(&breakaway, &offset, &gain))
+        {
+            MC_motor_model.breakaway[CHx] = breakaway;
+            MC_motor_model.offset[CHx] = offset;
+            MC_motor_model.gain[CHx] = gain;
+            MC_motor_model.valid[CHx] = 1;
+        }
+    }
+    // 缓冲压力环, 空闲时响应手动拉动滑块 (AMS lite 使用中按挤出速度送料, 见 BUFFER_CONTROL)
+    float _get_x_by_pressure(float control_voltage, float time_E)
+    {
+        float x = dir * PID_pressure.caculate(MC_PULL_stu_raw[CHx] - control_voltage, time_E);
+        TRACE(MOTOR_PRESSURE, (uint8_t)CHx, MC_PULL_stu_raw[CHx], x);
+        return x;
+    }
+    // AMS (P1X) 使用中的压力环: 只在越过目标的一侧出力, 输出平方增强
     float _get_x_by_pressure(float pressure_voltage, float control_voltage, float time_E, pressure_control_enum control_type)
     {
-        float x=0;
+        float x = 0;
         switch (control_type)
         {
-        case pressure_control_enum::all: // 全范围控制
-        {
-            x = dir * PID_pressure.caculate(MC_PULL_stu_raw[CHx] - control_voltage, time_E);
-            break;
-        }
         case pressure_control_enum::less_pressure: // 仅低压控制
         {
             if (pressure_voltage < control_voltage)
@@ -348,6 +654,7 @@ public:
             break;
         }
         }
+        TRACE(MOTOR_PRESSURE, (uint8_t)CHx, MC_PULL_stu_raw[CHx], x);
         if (x > 0) // 将控制力转为平方增强，平方会消掉正负，需要判断
             x = x * x / 250;
         else
@@ -357,12 +664,16 @@ public:
     void run(float time_E)
     {
         // 当处于退料状态，并且需要退料时，开始记录里程。
-        if (is_backing_out){
-            last_total_distance[CHx] += fabs(speed_as5600[CHx] * time_E);
+        if (MC_channel.backing_out[CHx]){
+            MC_channel.retract_distance[CHx] += fabs(speed_as5600[CHx] * time_E);
+        }
+        if (MC_channel.position[CHx] == filament_sending_out){
+            MC_channel.feed_distance[CHx] += fabs(speed_as5600[CHx] * time_E);
         }
         float speed_set = 0;
         float now_speed = speed_as5600[CHx];
         float x=0;
+        bool deadband_compensated = false;
 
         uint16_t device_type = get_now_BambuBus_device_type();
         static uint64_t countdownStart[4] = {0};          // 辅助进料倒计时
@@ -371,11 +682,11 @@ public:
             // 当 两个微动都被释放
             if (MC_ONLINE_key_stu[CHx] == 0)
             {
-                Assist_send_filament[CHx] = true; // 某通道离线后才可触发辅助进料一次
+                MC_channel.assist_send[CHx] = true; // 某通道离线后才可触发辅助进料一次
                 countdownStart[CHx] = 0;          // 清空倒计时
             }
 
-            if (Assist_send_filament[CHx] && is_two)
+            if (MC_channel.assist_send[CHx] && is_two)
             { // 允许状态，尝试辅助进料
                 if (MC_ONLINE_key_stu[CHx] == 2)
                 {                   // 触发外侧微动
@@ -388,10 +699,10 @@ public:
                         countdownStart[CHx] = get_time64();
                     }
                     uint64_t now = get_time64();
-                    if (now - countdownStart[CHx] >= Assist_send_time) // 倒计时
+                    if (now - countdownStart[CHx] >= MC_tuning.assist_send_time_ms) // 倒计时
                     {
                         x = 0;                             // 停止电机
-                        Assist_send_filament[CHx] = false; // 达成条件，完成一轮辅助进料。
+                        MC_channel.assist_send[CHx] = false; // 达成条件，完成一轮辅助进料。
                     }
                     else
                     {
@@ -405,7 +716,7 @@ public:
                 // 已经触发过，或微动触发在其他状态
                 if (MC_ONLINE_key_stu[CHx] != 0 && MC_PULL_stu[CHx] != 0)
                 { // 如果滑块被人为拉动，做出对应响应
-                    x = dir * PID_pressure.caculate(MC_PULL_stu_raw[CHx] - 1.65, time_E);
+                    x = _get_x_by_pressure(MC_tuning.pull_target_low, time_E);
                 }
                 else
                 { // 否则，保持停机
@@ -416,20 +727,38 @@ public:
         }
         else if (MC_ONLINE_key_stu[CHx] != 0) // 通道在运行状态，并且有耗材
         {
-            if (motion == filament_motion_enum::filament_motion_pressure_ctrl_on_use) // 在使用状态
+            if ((motion == filament_motion_enum::filament_motion_pressure_ctrl_on_use) &&
+                (device_type == BambuBus_AMS_lite)) // AMS lite 使用中
             {
-                if (pull_state_old) { // 首次进入使用中，不触发后退，冲刷会让缓冲归位.
+                // 按估计的挤出速度主动送料, 保持缓冲在中间
+                float centre = (MC_tuning.pull_target_low + MC_tuning.pull_target_high) / 2;
+                speed_set = buffer.update(MC_PULL_stu_raw[CHx], now_speed, centre, time_E);
+                speed_set = profile.update(speed_set, -1, time_E);
+                TRACE(BUFFER, (uint8_t)CHx, MC_PULL_stu_raw[CHx], buffer.get_rate(), speed_set);
+                if (speed_set == 0)
+                {
+                    PID_speed.clear();
+                }
+                else
+                {
+                    identify_model(speed_set, now_speed);
+                    x = speed_output(speed_set, now_speed, time_E, &deadband_compensated);
+                }
+            }
+            else if (motion == filament_motion_enum::filament_motion_pressure_ctrl_on_use) // AMS (P1X) 使用中
+            {
+                if (MC_channel.first_use[CHx]) { // 首次进入使用中，不触发后退，冲刷会让缓冲归位.
                     if (MC_PULL_stu_raw[CHx] < 1.55){
-                        pull_state_old = false; // 检测到耗材已处于低压力。
+                        MC_channel.first_use[CHx] = false; // 检测到耗材已处于低压力。
                     }
                 } else {
-                    if (MC_PULL_stu_raw[CHx] < 1.65)
+                    if (MC_PULL_stu_raw[CHx] < MC_tuning.pull_target_low)
                     {
-                        x = _get_x_by_pressure(MC_PULL_stu_raw[CHx], 1.65, time_E, pressure_control_enum::less_pressure);
+                        x = _get_x_by_pressure(MC_PULL_stu_raw[CHx], MC_tuning.pull_target_low, time_E, pressure_control_enum::less_pressure);
                     }
-                    else if (MC_PULL_stu_raw[CHx] > 1.7)
+                    else if (MC_PULL_stu_raw[CHx] > MC_tuning.pull_target_high)
                     {
-                        x = _get_x_by_pressure(MC_PULL_stu_raw[CHx], 1.7, time_E, pressure_control_enum::over_pressure);
+                        x = _get_x_by_pressure(MC_PULL_stu_raw[CHx], MC_tuning.pull_target_high, time_E, pressure_control_enum::over_pressure);
                     }
                 }
             }
@@ -438,6 +767,7 @@ public:
                 if (motion == filament_motion_enum::filament_motion_stop) // 要求停止
                 {
                     PID_speed.clear();
+                    profile.reset(0);
                     Motion_control_set_PWM(CHx, 0);
                     return;
                 }
@@ -445,7 +775,7 @@ public:
                 {
                     if (device_type == BambuBus_AMS_lite)
                     {
-                        if (MC_PULL_stu_raw[CHx] < PULL_VOLTAGE_SEND_MAX) // 压力主动到这个位置
+                        if (MC_PULL_stu_raw[CHx] < MC_tuning.pull_voltage_send_max) // 压力主动到这个位置
                         {
                             speed_set = 30;
                         }
@@ -456,7 +786,7 @@ public:
                     }
                     else
                     {
-                        speed_set = 50; // P系全力以赴
+                        speed_set = FEED_SPEED_MM_S; // P系全力以赴
                     }
                 }
                 if (motion == filament_motion_enum::filament_motion_slow_send) // 要求缓慢送料
@@ -465,9 +795,12 @@ public:
                 }
                 if (motion == filament_motion_enum::filament_motion_pull) // 回抽
                 {
-                    speed_set = -50;
+                    speed_set = -RETRACT_SPEED_MM_S;
                 }
-                x = dir * PID_speed.caculate(now_speed - speed_set, time_E);
+                speed_set = profile.update(speed_set, distance_left, time_E); // 加减速曲线
+                identify_model(speed_set, now_speed);
+                x = speed_output(speed_set, now_speed, time_E, &deadband_compensated);
+                TRACE(MOTOR_PID, (uint8_t)CHx, (uint8_t)motion, speed_set, now_speed, x);
             }
         }
         else // 运行过程中耗材用完，需要停止电机控制
@@ -475,12 +808,38 @@ public:
             x = 0;
         }
 
-        if (x > 10)
-            x += pwm_zero;
-        else if (x < -10)
-            x -= pwm_zero;
-        else
-            x = 0;
+        Motion_control_set_PWM(CHx, output_limit(x, deadband_compensated));
+    }
+    /**
+     * Speed loop output: PID plus the motor model feed-forward when there is one
+     * @param compensated set when the feed-forward already covers the deadband
+     */
+    float speed_output(float speed_set, float now_speed, float time_E, bool *compensated)
+    {
+        float x = dir * PID_speed.caculate(now_speed - speed_set, time_E);
+        float feedforward = Motor_model_feedforward(CHx, speed_set, now_speed);
+        if (feedforward != 0) // 模型已包含死区和摩擦, PID 只补偿残差
+        {
+            x -= dir * feedforward;
+            *compensated = true;
+        }
+        return x;
+    }
+    /**
+     * Add deadband compensation unless already included, then clamp to the PWM range
+     */
+    float output_limit(float x, bool compensated)
+    {
+        if (!compensated) // 死区补偿: 辨识出的起转 PWM, 没有模型时用固定的 pwm_zero
+        {
+            float deadband = (MOTOR_MODEL_ENABLED && MC_motor_model.valid[CHx]) ? MC_motor_model.breakaway[CHx] : pwm_zero;
+            if (x > 10)
+                x += deadband;
+            else if (x < -10)
+                x -= deadband;
+            else
+                x = 0;
+        }
 
         if (x > PWM_lim)
         {
@@ -490,15 +849,554 @@ public:
         {
             x = -PWM_lim;
         }
-
-        Motion_control_set_PWM(CHx, x);
+        return x;
     }
 };
 _MOTOR_CONTROL MOTOR_CONTROL[4] = {_MOTOR_CONTROL(0), _MOTOR_CONTROL(1), _MOTOR_CONTROL(2), _MOTOR_CONTROL(3)};
 
+#define Motion_control_tuning_version 2 // 2: buffer_mm_per_v
+Motion_control_tuning_struct MC_tuning;
+
+void Motion_control_tuning_defaults()
+{
+    MC_tuning.speed_P = MOTOR_SPEED_PID_P;
+    MC_tuning.speed_I = MOTOR_SPEED_PID_I;
+    MC_tuning.speed_D = MOTOR_SPEED_PID_D;
+    MC_tuning.pressure_P = MOTOR_PRESSURE_PID_P;
+    MC_tuning.pressure_I = MOTOR_PRESSURE_PID_I;
+    MC_tuning.pressure_D = MOTOR_PRESSURE_PID_D;
+    MC_tuning.pull_voltage_high = PULL_VOLTAGE_HIGH;
+    MC_tuning.pull_voltage_low = PULL_VOLTAGE_LOW;
+    MC_tuning.pull_voltage_send_max = PULL_VOLTAGE_SEND_MAX;
+    MC_tuning.pull_target_low = PULL_VOLTAGE_TARGET_LOW;
+    MC_tuning.pull_target_high = PULL_VOLTAGE_TARGET_HIGH;
+    MC_tuning.assist_send_time_ms = ASSIST_SEND_TIME_MS;
+    MC_tuning.buffer_mm_per_v = BUFFER_MM_PER_V;
+}
+
+/**
+ * Per-channel PID gains found by the auto-tuner; channels without them use MC_tuning.
+ * Kept under their own keys next to FLASH_KV_KEY_MOTION_DIR, whose record
+ * has no room left under FLASH_KV_MAX_VALUE.
+ */
+struct PID_gains_save_struct
+{
+    float P[MAX_FILAMENT_CHANNELS];
+    float I[MAX_FILAMENT_CHANNELS];
+    float D[MAX_FILAMENT_CHANNELS];
+    uint8_t valid[MAX_FILAMENT_CHANNELS];
+};
+#define PID_gains_version 2 // 2: 压力环输出不再平方
+static_assert(sizeof(PID_gains_save_struct) <= FLASH_KV_MAX_VALUE, "PID gains do not fit in one flash record");
+PID_gains_save_struct MC_speed_gains = {};
+PID_gains_save_struct MC_pressure_gains = {};
+
+// Push changed gains into the controllers; clears their integrators
+void Motion_control_tuning_apply()
+{
+    for (int i = 0; i < 4; i++)
+    {
+        if (MC_speed_gains.valid[i])
+            MOTOR_CONTROL[i].PID_speed.init_PID(MC_speed_gains.P[i], MC_speed_gains.I[i], MC_speed_gains.D[i]);
+        else
+            MOTOR_CONTROL[i].PID_speed.init_PID(MC_tuning.speed_P, MC_tuning.speed_I, MC_tuning.speed_D);
+        if (MC_pressure_gains.valid[i])
+            MOTOR_CONTROL[i].PID_pressure.init_PID(MC_pressure_gains.P[i], MC_pressure_gains.I[i], MC_pressure_gains.D[i]);
+        else
+            MOTOR_CONTROL[i].PID_pressure.init_PID(MC_tuning.pressure_P, MC_tuning.pressure_I, MC_tuning.pressure_D);
+    }
+}
+
+bool Motion_control_tuning_save()
+{
+    return Flash_kv_write(FLASH_KV_KEY_TUNING, Motion_control_tuning_version, &MC_tuning, sizeof(MC_tuning));
+}
+
+/**
+ * Queue the records marked in MC_save_pending. One the queue refuses stays
+ * marked and is queued again from the next CONTROL tick, so a direction or
+ * tuned gain is never lost to a full queue.
+ */
+void Motion_control_save_pending()
+{
+    if ((MC_save_pending & MC_SAVE_DIR) &&
+        Flash_kv_write(FLASH_KV_KEY_MOTION_DIR, Motion_control_save_version, &Motion_control_data_save,
+                       sizeof(Motion_control_save_struct)))
+        MC_save_pending &= ~MC_SAVE_DIR;
+    if ((MC_save_pending & MC_SAVE_SPEED_GAINS) &&
+        Flash_kv_write(FLASH_KV_KEY_SPEED_GAINS, PID_gains_version, &MC_speed_gains, sizeof(MC_speed_gains)))
+        MC_save_pending &= ~MC_SAVE_SPEED_GAINS;
+    if ((MC_save_pending & MC_SAVE_PRESSURE_GAINS) &&
+        Flash_kv_write(FLASH_KV_KEY_PRESSURE_GAINS, PID_gains_version, &MC_pressure_gains, sizeof(MC_pressure_gains)))
+        MC_save_pending &= ~MC_SAVE_PRESSURE_GAINS;
+}
+
+/**
+ * Queue the motor model for saving when a channel's parameters have moved by
+ * more than 10% since the last save, at most every MOTOR_MODEL_SAVE_INTERVAL_MS
+ */
+void Motor_model_save_if_changed()
+{
+    uint64_t now = get_time64();
+    if (MC_motor_model_save_time && (now - MC_motor_model_save_time < MOTOR_MODEL_SAVE_INTERVAL_MS))
+        return;
+    bool changed = false;
+    for (int i = 0; i < MAX_FILAMENT_CHANNELS; i++)
+    {
+        if (MC_motor_model.valid[i] != MC_motor_model_saved.valid[i])
+            changed = true;
+        else if (MC_motor_model.valid[i] &&
+                 ((fabsf(MC_motor_model.gain[i] - MC_motor_model_saved.gain[i]) > 0.1f * MC_motor_model_saved.gain[i]) ||
+                  (fabsf(MC_motor_model.offset[i] - MC_motor_model_saved.offset[i]) > 0.1f * MC_motor_model_saved.offset[i] + 10) ||
+                  (fabsf(MC_motor_model.breakaway[i] - MC_motor_model_saved.breakaway[i]) > 0.1f * MC_motor_model_saved.breakaway[i] + 10)))
+            changed = true;
+    }
+    if (!changed)
+        return;
+    if (Flash_kv_write(FLASH_KV_KEY_MOTOR_MODEL, Motor_model_version, &MC_motor_model, sizeof(MC_motor_model)))
+    {
+        MC_motor_model_saved = MC_motor_model;
+        MC_motor_model_save_time = now;
+    }
+}
+
+void Motor_model_load()
+{
+    if (Flash_kv_read(FLASH_KV_KEY_MOTOR_MODEL, Motor_model_version, &MC_motor_model, sizeof(MC_motor_model)))
+        MC_motor_model_saved = MC_motor_model;
+}
+
+/**
+ * Forget the identified model of every channel; feed-forward stops until it is learned again
+ */
+void Motion_control_model_reset()
+{
+    memset(&MC_motor_model, 0, sizeof(MC_motor_model));
+    for (int i = 0; i < MAX_FILAMENT_CHANNELS; i++)
+    {
+        MOTOR_CONTROL[i].model_fit.clear();
+        MOTOR_CONTROL[i].model_last_speed = 0;
+    }
+    MC_motor_model_save_time = 0; // 立即保存
+    Motor_model_save_if_changed();
+}
+
+/**
+ * Identified model of one channel
+ * @return false while the channel has not been identified
+ */
+bool Motion_control_model_get(int CHx, float *breakaway, float *offset, float *gain, int *samples)
+{
+    *breakaway = MC_motor_model.breakaway[CHx];
+    *offset = MC_motor_model.offset[CHx];
+    *gain = MC_motor_model.gain[CHx];
+    *samples = MOTOR_CONTROL[CHx].model_fit.samples();
+    return MC_motor_model.valid[CHx];
+}
+
+void Motion_control_tuning_load()
+{
+    if (!Flash_kv_read(FLASH_KV_KEY_TUNING, Motion_control_tuning_version, &MC_tuning, sizeof(MC_tuning)))
+        Motion_control_tuning_defaults();
+    Flash_kv_read(FLASH_KV_KEY_SPEED_GAINS, PID_gains_version, &MC_speed_gains, sizeof(MC_speed_gains));
+    Flash_kv_read(FLASH_KV_KEY_PRESSURE_GAINS, PID_gains_version, &MC_pressure_gains, sizeof(MC_pressure_gains));
+    Motion_control_tuning_apply();
+}
+
+/**
+ * Relay auto-tune
+ *
+ * Speed loop: the channel is driven by a relay, bias +/- AUTOTUNE_SPEED_RELAY_PWM,
+ * switched as the speed crosses AUTOTUNE_SPEED_MM_S, first forwards and then
+ * backwards until the filament is back where it started, so the test moves
+ * at most AUTOTUNE_MAX_TRAVEL_MM each way. The bias is trimmed every cycle
+ * so the relay spends equal time high and low.
+ * Pressure loop: the relay drives the buffer around the middle of the
+ * pull_target band with +/- AUTOTUNE_PRESSURE_RELAY_PWM; filament only moves
+ * as far as the buffer travels.
+ *
+ * From the limit cycle amplitude a and period Tu: Ku = 4d / (pi a), and the
+ * Tyreus-Luyben PI rules Kp = Ku / 3.2, Ki = Kp / (2.2 Tu), which oscillate
+ * less than Ziegler-Nichols. The pressure gains are computed for the linear
+ * loop that drives the buffer slider of an idle channel. The AMS (P1X) in-use
+ * loop shares them but squares its output; an AMS lite channel in use is fed
+ * by the speed loop at the estimated extrusion rate (BUFFER_CONTROL). The new
+ * gains are then checked on a closed-loop run (speed: a step each way,
+ * pressure: holding the target); they are stored only if that run is stable,
+ * otherwise the old gains are put back.
+ */
+enum class Autotune_state : uint8_t
+{
+    idle,
+    relay_forward,
+    relay_back,
+    validate_forward,
+    validate_back,
+    done,
+    failed,
+};
+
+struct Autotune_channel
+{
+    Autotune_state state;
+    bool pressure;         ///< Tuning the pressure loop rather than the speed loop
+    bool pending;          ///< Start the speed test once the channel is idle
+    uint64_t phase_time;   ///< Phase start (ms)
+    uint64_t switch_time;  ///< Last relay switch (ms)
+    uint64_t rise_time;    ///< Last low-to-high switch (ms), 0 before the first
+    float travel;          ///< Filament moved since the test started (mm)
+    float bias;            ///< Relay centre output (|PWM|)
+    bool high;             ///< Relay output is high
+    uint32_t time_high;    ///< Time high/low in the current cycle (ms)
+    uint32_t time_low;
+    float peak_max, peak_min;
+    int cycles;            ///< Low-to-high switches so far
+    int measured;          ///< Cycles averaged into period_sum/amp_sum
+    float period_sum;      ///< s
+    float amp_sum;
+    float P, I;            ///< Result under validation
+    float peak;            ///< Validation: largest overshoot seen
+    float error_sum;       ///< Validation: |error| summed over the second half
+    int error_n;
+};
+Autotune_channel MC_autotune[MAX_FILAMENT_CHANNELS];
+
+static void Autotune_log(int CHx, const char *text)
+{
+    LOG_IF(MOTION, INFO)
+    {
+        DEBUG_MY("Autotune: CH");
+        DEBUG_float(CHx, 0);
+        DEBUG_MY(text);
+    }
+}
+
+static void Autotune_finish(int CHx, bool ok)
+{
+    Autotune_channel &t = MC_autotune[CHx];
+    Motion_control_set_PWM(CHx, 0);
+    if (ok)
+    {
+        PID_gains_save_struct &gains = t.pressure ? MC_pressure_gains : MC_speed_gains;
+        gains.P[CHx] = t.P;
+        gains.I[CHx] = t.I;
+        gains.D[CHx] = 0;
+        gains.valid[CHx] = 1;
+        MC_save_pending |= t.pressure ? MC_SAVE_PRESSURE_GAINS : MC_SAVE_SPEED_GAINS;
+        Motion_control_save_pending();
+        LOG_IF(MOTION, INFO)
+        {
+            DEBUG_MY("Autotune: CH");
+            DEBUG_float(CHx, 0);
+            DEBUG_MY(t.pressure ? " pressure P=" : " speed P=");
+            DEBUG_float(t.P, 3);
+            DEBUG_MY(" I=");
+            DEBUG_float(t.I, 3);
+            DEBUG_MY("\n");
+        }
+    }
+    else
+    {
+        Autotune_log(CHx, " failed, gains unchanged\n");
+    }
+    t.state = ok ? Autotune_state::done : Autotune_state::failed;
+    Motion_control_tuning_apply(); // 成功则用新参数, 失败则恢复原参数
+}
+
+static void Autotune_phase(int CHx, Autotune_state state)
+{
+    Autotune_channel &t = MC_autotune[CHx];
+    t.state = state;
+    t.phase_time = get_time64();
+    t.switch_time = t.phase_time;
+    t.rise_time = 0;
+    t.time_high = t.time_low = 0;
+    t.high = true;
+    t.cycles = 0;
+    t.peak_max = t.peak_min = 0;
+    t.peak = 0;
+    t.error_sum = 0;
+    t.error_n = 0;
+    MOTOR_CONTROL[CHx].PID_speed.clear();
+    MOTOR_CONTROL[CHx].PID_pressure.clear();
+}
+
+/**
+ * A relay test takes over a motor for several seconds: never while the printer
+ * prints or any channel is in the middle of a filament change
+ */
+static bool Autotune_printer_busy()
+{
+    if (BambuBus_if_on_print() || (MC_change.from >= 0))
+        return true;
+    for (int i = 0; i < MAX_FILAMENT_CHANNELS; i++)
+    {
+        if ((MC_channel.position[i] == filament_pulling_back) || (MC_channel.position[i] == filament_sending_out))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Start a relay test on one channel; it must be idle with filament present,
+ * and the printer idle
+ * @param pressure tune the buffer pressure loop instead of the speed loop
+ * @return false if the channel cannot be tuned now
+ */
+bool Motion_control_autotune_start(int CHx, bool pressure)
+{
+    if ((CHx < 0) || (CHx >= MAX_FILAMENT_CHANNELS) || Motion_control_calibrating() || (MOTOR_CONTROL[CHx].dir == 0))
+        return false;
+    if (Autotune_printer_busy())
+        return false;
+    if ((MC_channel.position[CHx] != filament_idle) || (MC_ONLINE_key_stu[CHx] == 0))
+        return false;
+    if (pressure && (MC_ONLINE_key_stu[CHx] != 1)) // 压力测试需要耗材穿过缓冲
+        return false;
+    Autotune_channel &t = MC_autotune[CHx];
+    memset(&t, 0, sizeof(t));
+    t.pressure = pressure;
+    t.bias = pressure ? 0 : fabsf(Motor_model_feedforward(CHx, AUTOTUNE_SPEED_MM_S, AUTOTUNE_SPEED_MM_S));
+    if (t.bias == 0)
+        t.bias = MOTOR_CONTROL[CHx].pwm_zero;
+    Autotune_phase(CHx, Autotune_state::relay_forward);
+    Autotune_log(CHx, pressure ? " pressure relay test\n" : " speed relay test\n");
+    return true;
+}
+
+bool Motion_control_autotune_active(int CHx)
+{
+    Autotune_state state = MC_autotune[CHx].state;
+    return (state != Autotune_state::idle) && (state != Autotune_state::done) && (state != Autotune_state::failed);
+}
+
+/**
+ * Tuning state of one channel for the console
+ * @return 0 idle, 1 running, 2 done, 3 failed
+ */
+int Motion_control_autotune_status(int CHx, bool *pressure, float *P, float *I)
+{
+    const Autotune_channel &t = MC_autotune[CHx];
+    *pressure = t.pressure;
+    *P = t.P;
+    *I = t.I;
+    if (Motion_control_autotune_active(CHx))
+        return 1;
+    return (t.state == Autotune_state::done) ? 2 : (t.state == Autotune_state::failed) ? 3 : 0;
+}
+
+/**
+ * Forget all tuned gains; every channel goes back to MC_tuning
+ */
+void Motion_control_autotune_clear()
+{
+    memset(&MC_speed_gains, 0, sizeof(MC_speed_gains));
+    memset(&MC_pressure_gains, 0, sizeof(MC_pressure_gains));
+    MC_save_pending |= MC_SAVE_SPEED_GAINS | MC_SAVE_PRESSURE_GAINS;
+    Motion_control_save_pending();
+    Motion_control_tuning_apply();
+}
+
+/**
+ * Ask for a speed test once the channel is next idle, if it has no tuned gains yet
+ */
+void Motion_control_autotune_request(int CHx)
+{
+    if (AUTOTUNE_AFTER_LEARNING && !MC_speed_gains.valid[CHx])
+        MC_autotune[CHx].pending = true;
+}
+
+// One relay step; returns the output the relay asks for, >0 pushes y up
+static float Autotune_relay(Autotune_channel &t, float y, float target, float hysteresis, float d, uint64_t now)
+{
+    if (y > t.peak_max)
+        t.peak_max = y;
+    if (y < t.peak_min)
+        t.peak_min = y;
+    if (t.high && (y > target + hysteresis))
+    {
+        t.time_high += now - t.switch_time;
+        t.switch_time = now;
+        t.high = false;
+    }
+    else if (!t.high && (y < target - hysteresis))
+    {
+        t.time_low += now - t.switch_time;
+        t.switch_time = now;
+        t.high = true;
+        if (t.rise_time && (t.cycles >= 2)) // 前两个周期还在建立振荡, 不计入
+        {
+            t.period_sum += (now - t.rise_time) / 1000.0f;
+            t.amp_sum += (t.peak_max - t.peak_min) / 2;
+            t.measured++;
+        }
+        if (t.time_high + t.time_low) // 调整偏置, 让高低电平时间相等
+            t.bias += 0.5f * d * ((float)t.time_high - (float)t.time_low) / (t.time_high + t.time_low);
+        t.cycles++;
+        t.rise_time = now;
+        t.time_high = t.time_low = 0;
+        t.peak_max = t.peak_min = y;
+    }
+    else if (now - t.switch_time > AUTOTUNE_SWITCH_TIMEOUT_MS) // 偏置太大或太小, 没有振荡
+    {
+        t.bias += (y < target) ? d / 2 : -d / 2;
+        t.switch_time = now;
+    }
+    return t.high ? t.bias + d : t.bias - d;
+}
+
+// Gains from the measured limit cycle; false if there was none
+static bool Autotune_compute(Autotune_channel &t, float d, float hysteresis)
+{
+    if (t.measured < AUTOTUNE_CYCLES)
+        return false;
+    float a = t.amp_sum / t.measured;
+    float Tu = t.period_sum / t.measured;
+    if ((a <= hysteresis) || (Tu <= 0))
+        return false;
+    a = sqrtf(a * a - hysteresis * hysteresis); // 滞环修正
+    float Ku = 4 * d / (AS5600_PI * a);
+    float Kp = Ku / 3.2f;
+    float Ki = Kp / (2.2f * Tu);
+    t.P = Kp;
+    t.I = Ki;
+    return isfinite(t.P) && isfinite(t.I) && (t.P > 0);
+}
+
+/**
+ * Run the test on one channel for one control step; the channel's normal control is skipped meanwhile
+ */
+void Motion_control_autotune_run(int CHx, float time_E)
+{
+    Autotune_channel &t = MC_autotune[CHx];
+    _MOTOR_CONTROL &motor = MOTOR_CONTROL[CHx];
+    uint64_t now = get_time64();
+    float speed = speed_as5600[CHx];
+    t.travel += speed * time_E;
+    if ((MC_channel.position[CHx] != filament_idle) || (MC_ONLINE_key_stu[CHx] == 0) || Autotune_printer_busy()) // 打印机要用, 或耗材被拔出
+    {
+        Autotune_log(CHx, " aborted\n");
+        Autotune_finish(CHx, false);
+        return;
+    }
+
+    if (t.pressure)
+    {
+        float target = (MC_tuning.pull_target_low + MC_tuning.pull_target_high) / 2;
+        float y = MC_PULL_stu_raw[CHx];
+        switch (t.state)
+        {
+        case Autotune_state::relay_forward:
+        {
+            float u = Autotune_relay(t, y, target, AUTOTUNE_PRESSURE_HYSTERESIS_V, AUTOTUNE_PRESSURE_RELAY_PWM, now);
+            // 和 _get_x_by_pressure 同号: dir * (y - target) 使压力下降
+            Motion_control_set_PWM(CHx, motor.output_limit(-motor.dir * u, false));
+            if ((t.measured >= AUTOTUNE_CYCLES) || (now - t.phase_time > AUTOTUNE_TIMEOUT_MS))
+            {
+                if (!Autotune_compute(t, AUTOTUNE_PRESSURE_RELAY_PWM, AUTOTUNE_PRESSURE_HYSTERESIS_V))
+                {
+                    Autotune_finish(CHx, false);
+                    break;
+                }
+                motor.PID_pressure.init_PID(t.P, t.I, 0);
+                Autotune_phase(CHx, Autotune_state::validate_forward);
+            }
+            break;
+        }
+        case Autotune_state::validate_forward:
+        {
+            float x = motor._get_x_by_pressure(target, time_E);
+            Motion_control_set_PWM(CHx, motor.output_limit(x, false));
+            if (now - t.phase_time > AUTOTUNE_VALIDATE_MS / 2)
+            {
+                t.error_sum += fabsf(y - target);
+                t.error_n++;
+            }
+            if (now - t.phase_time > AUTOTUNE_VALIDATE_MS)
+                Autotune_finish(CHx, t.error_n && (t.error_sum / t.error_n < AUTOTUNE_PRESSURE_TOLERANCE_V));
+            break;
+        }
+        default:
+            Autotune_finish(CHx, false);
+            break;
+        }
+        return;
+    }
+
+    float sign = ((t.state == Autotune_state::relay_back) || (t.state == Autotune_state::validate_back)) ? -1 : 1;
+    float y = sign * speed; // 测试方向上的速度
+    switch (t.state)
+    {
+    case Autotune_state::relay_forward:
+    case Autotune_state::relay_back:
+    {
+        float u = Autotune_relay(t, y, AUTOTUNE_SPEED_MM_S, AUTOTUNE_SPEED_HYSTERESIS_MM_S, AUTOTUNE_SPEED_RELAY_PWM, now);
+        if (u < 0) // 只减速, 不反转
+            u = 0;
+        if (u > PWM_lim)
+            u = PWM_lim;
+        Motion_control_set_PWM(CHx, -motor.dir * sign * u);
+        bool enough = (t.state == Autotune_state::relay_forward) &&
+                      ((t.measured >= AUTOTUNE_CYCLES) || (t.travel >= AUTOTUNE_MAX_TRAVEL_MM));
+        bool back_home = (t.state == Autotune_state::relay_back) && (t.travel <= 0);
+        if (now - t.phase_time > AUTOTUNE_TIMEOUT_MS)
+        {
+            Autotune_finish(CHx, false);
+        }
+        else if (enough)
+        {
+            Autotune_phase(CHx, Autotune_state::relay_back);
+        }
+        else if (back_home)
+        {
+            if (!Autotune_compute(t, AUTOTUNE_SPEED_RELAY_PWM, AUTOTUNE_SPEED_HYSTERESIS_MM_S))
+            {
+                Autotune_finish(CHx, false);
+                break;
+            }
+            motor.PID_speed.init_PID(t.P, t.I, 0);
+            Autotune_phase(CHx, Autotune_state::validate_forward);
+        }
+        break;
+    }
+    case Autotune_state::validate_forward:
+    case Autotune_state::validate_back:
+    {
+        // 新参数下的阶跃响应: 超调和稳态误差都要小
+        bool compensated = false;
+        float x = motor.speed_output(sign * AUTOTUNE_SPEED_MM_S, speed, time_E, &compensated);
+        Motion_control_set_PWM(CHx, motor.output_limit(x, compensated));
+        if (y - AUTOTUNE_SPEED_MM_S > t.peak)
+            t.peak = y - AUTOTUNE_SPEED_MM_S;
+        if (now - t.phase_time > AUTOTUNE_VALIDATE_MS / 2)
+        {
+            t.error_sum += fabsf(y - AUTOTUNE_SPEED_MM_S);
+            t.error_n++;
+        }
+        if (now - t.phase_time <= AUTOTUNE_VALIDATE_MS)
+            break;
+        bool stable = t.error_n && (t.peak < AUTOTUNE_MAX_OVERSHOOT * AUTOTUNE_SPEED_MM_S) &&
+                      (t.error_sum / t.error_n < AUTOTUNE_MAX_ERROR * AUTOTUNE_SPEED_MM_S);
+        if (!stable)
+            Autotune_finish(CHx, false);
+        else if (t.state == Autotune_state::validate_forward)
+            Autotune_phase(CHx, Autotune_state::validate_back); // 反向走回去, 同时再验证一次
+        else
+            Autotune_finish(CHx, true);
+        break;
+    }
+    default:
+        Autotune_finish(CHx, false);
+        break;
+    }
+}
+
+int16_t Motion_control_pwm[MAX_FILAMENT_CHANNELS] = {0, 0, 0, 0};
 void Motion_control_set_PWM(uint8_t CHx, int PWM)//传递到硬件层控制电机的PWM
 {
     uint16_t set1 = 0, set2 = 0;
+    if (CHx < MAX_FILAMENT_CHANNELS)
+        Motion_control_pwm[CHx] = PWM;
     if (PWM > 0)
     {
         set1 = PWM;
@@ -583,43 +1481,36 @@ void AS5600_distance_updata()//读取as5600，更新相关的数据
     time_last = time_now;
 }
 
-enum filament_now_position_enum
-{
-    filament_idle,
-    filament_sending_out,
-    filament_using,
-    filament_pulling_back,
-    filament_redetect,
-};
-int filament_now_position[4];
-bool wait = false;
-
 bool Prepare_For_filament_Pull_Back(float_t OUT_filament_meters)
 {
     bool wait = false;
     for (int i = 0; i < 4; i++)
     {
-        if (filament_now_position[i] == filament_pulling_back)
+        if (MC_channel.position[i] == filament_pulling_back)
         {
-            // DEBUG_MY("last_total_distance: "); // 输出调试信息
-            // Debug_log_write_float(last_total_distance[i], 5);
-            if (last_total_distance[i] < OUT_filament_meters)
+            // DEBUG_MY("retract_distance: "); // 输出调试信息
+            // Debug_log_write_float(MC_channel.retract_distance[i], 5);
+            if (MC_channel.retract_distance[i] < OUT_filament_meters)
             {
                 // 未到达时进行退料
                 MOTOR_CONTROL[i].set_motion(filament_motion_enum::filament_motion_pull, 100); // 驱动电机退料
-                // 渐变灯效
-                float npercent = (last_total_distance[i] / OUT_filament_meters) * 100.0f;
-                MC_STU_RGB_set(i, 255 - ((255 / 100) * npercent), 125 - ((125 / 100) * npercent), (255 / 100) * npercent);
+                MOTOR_CONTROL[i].set_distance_left(OUT_filament_meters - MC_channel.retract_distance[i]); // 接近终点时减速
+                // 渐变灯效：橙色渐变到蓝色
+                float progress = (MC_channel.retract_distance[i] / OUT_filament_meters) * 255.0f;
+                LED_anim_post(i, 0, LED_LAYER_PROGRESS, LED_PATTERN_PROGRESS, LED_rgb(255, 125, 0), LED_rgb(0, 0, 255));
+                LED_anim_progress(i, 0, progress < 0 ? 0 : (uint8_t)progress);
                 // 退料未完成需要优先处理
             }
             else
             {
                 // 到达停止距离
-                is_backing_out = false; // 无需继续记录距离
+                MC_channel.backing_out[i] = false; // 无需继续记录距离
                 MOTOR_CONTROL[i].set_motion(filament_motion_enum::filament_motion_stop, 100); // 停止电机
-                filament_now_position[i] = filament_idle;               // 设置当前位置为空闲
+                MC_channel.position[i] = filament_idle;               // 设置当前位置为空闲
                 set_filament_motion(i, AMS_filament_motion::idle);      // 强制进入空闲
-                last_total_distance[i] = 0;                             // 重置退料距离
+                MC_channel.retract_distance[i] = 0;                             // 重置退料距离
+                if (MC_change.from == i)
+                    MC_change.retract_time = get_time64();
                 // 退料完成
             }
             // 只要在退料状态就必须等待，直到不在退料中，下次循环后才不需要等待。
@@ -628,15 +1519,76 @@ bool Prepare_For_filament_Pull_Back(float_t OUT_filament_meters)
     }
     return wait;
 }
-void motor_motion_switch() // 通道状态切换函数，只控制当前在使用的通道，其他通道设置为停止
+/**
+ * Change planner: how far may the incoming channel feed now? While another
+ * channel is still retracting, the incoming one waits until the outgoing
+ * filament has backed off CHANGE_OVERLAP_START_MM, then pre-feeds at most
+ * CHANGE_PREFEED_MM (both measured by the AS5600s) so the two tips never meet
+ * at the hub.
+ * @return remaining distance in mm, 0 to hold, -1 when not limited
+ */
+float Change_planner_feed_left(int num)
+{
+    for (int i = 0; i < MAX_FILAMENT_CHANNELS; i++)
+    {
+        if ((i == num) || (MC_channel.position[i] != filament_pulling_back))
+            continue;
+        if (MC_channel.retract_distance[i] < CHANGE_OVERLAP_START_MM)
+            return 0;
+        float left = CHANGE_PREFEED_MM - MC_channel.feed_distance[num];
+        return (left > 0) ? left : 0;
+    }
+    return -1;
+}
+
+// The incoming channel has reached the extruder: the swap is over
+void Change_planner_finish(int num)
+{
+    if ((MC_change.from < 0) || (MC_change.from == num))
+        return;
+    uint64_t now = get_time64();
+    uint64_t retract_end = MC_change.retract_time ? MC_change.retract_time : now;
+    MC_change.last_ms = now - MC_change.start_time;
+    MC_change.last_overlap_ms = (MC_change.feed_time && (retract_end > MC_change.feed_time)) ? retract_end - MC_change.feed_time : 0;
+    MC_change.count++;
+    TRACE(FILAMENT_CHANGE, (uint8_t)MC_change.from, (uint8_t)num, MC_change.last_ms, MC_change.last_overlap_ms);
+    LOG_IF(MOTION, INFO)
+    {
+        DEBUG_MY("Change: ms ");
+        DEBUG_float(MC_change.last_ms, 0);
+        DEBUG_MY(" overlap ms ");
+        DEBUG_float(MC_change.last_overlap_ms, 0);
+        DEBUG_MY("\n");
+    }
+    MC_change.from = -1;
+}
+
+/**
+ * Duration of the last filament swap and the number of swaps since boot
+ */
+void Motion_control_change_stats(uint32_t *last_ms, uint32_t *overlap_ms, uint32_t *count)
+{
+    *last_ms = MC_change.last_ms;
+    *overlap_ms = MC_change.last_overlap_ms;
+    *count = MC_change.count;
+}
+
+/**
+ * 通道状态切换函数，只控制当前在使用的通道，其他通道设置为停止
+ * @param overlap true when Prepare_For_filament_Pull_Back() drives retracting channels (AMS);
+ *        those are left alone and the next channel may start under Change_planner_feed_left()
+ */
+void motor_motion_switch(bool overlap)
 {
     int num = get_now_filament_num();                      // 当前通道号
     uint16_t device_type = get_now_BambuBus_device_type(); // 设备类型
     for (int i = 0; i < 4; i++)
     {
+        if (overlap && (MC_channel.position[i] == filament_pulling_back))
+            continue; // 退料由 Prepare_For_filament_Pull_Back 控制
         if (i != num)
         {
-            filament_now_position[i] = filament_idle;
+            MC_channel.position[i] = filament_idle;
             MOTOR_CONTROL[i].set_motion(filament_motion_enum::filament_motion_pressure_ctrl_idle, 1000);
         }
         else if (MC_ONLINE_key_stu[num] == 1 || MC_ONLINE_key_stu[num] == 3) // 通道有耗材丝
@@ -645,8 +1597,20 @@ void motor_motion_switch() // 通道状态切换函数，只控制当前在使
             {
             case AMS_filament_motion::need_send_out: // 需要进料
                 MC_STU_RGB_set(num, 00, 255, 00);
-                filament_now_position[num] = filament_sending_out;
+                if (MC_channel.position[num] != filament_sending_out)
+                    MC_channel.feed_distance[num] = 0;
+                MC_channel.position[num] = filament_sending_out;
+            {
+                float feed_left = Change_planner_feed_left(num);
+                if (feed_left == 0) // 上一通道还在退料
+                {
+                    MOTOR_CONTROL[num].set_motion(filament_motion_enum::filament_motion_stop, 100);
+                    break;
+                }
+                if ((MC_change.from >= 0) && (MC_change.feed_time == 0))
+                    MC_change.feed_time = get_time64();
                 MOTOR_CONTROL[num].set_motion(filament_motion_enum::filament_motion_send, 100);
+                MOTOR_CONTROL[num].set_distance_left(feed_left); // 预进料在安全距离处停下
                 
                 // Start loading direction detection if we don't know the loading direction yet
                 if (loading_detection[num].confirmed_loading_direction == 0 && 
@@ -660,10 +1624,18 @@ void motor_motion_switch() // 通道状态切换函数，只控制当前在使
                     start_direction_learning(num, -1); // Feeding direction is typically negative
                 }
                 break;
+            }
             case AMS_filament_motion::need_pull_back:
-                pull_state_old = false; // 重置标记
-                is_backing_out = true; // 标记正在回退
-                filament_now_position[num] = filament_pulling_back;
+                if (MC_channel.position[num] != filament_pulling_back) // 换料开始
+                {
+                    MC_change.from = num;
+                    MC_change.start_time = get_time64();
+                    MC_change.feed_time = 0;
+                    MC_change.retract_time = 0;
+                }
+                MC_channel.first_use[num] = false; // 重置标记
+                MC_channel.backing_out[num] = true; // 标记正在回退
+                MC_channel.position[num] = filament_pulling_back;
                 if (device_type == BambuBus_AMS_lite)
                 {
                     MOTOR_CONTROL[num].set_motion(filament_motion_enum::filament_motion_pull, 100);
@@ -673,19 +1645,19 @@ void motor_motion_switch() // 通道状态切换函数，只控制当前在使
             case AMS_filament_motion::before_pull_back:
             case AMS_filament_motion::on_use:
             {
-                static uint64_t time_end = 0;
                 uint64_t time_now = get_time64();
-                if (filament_now_position[num] == filament_sending_out) // 如果通道刚开始进料
+                if (MC_channel.position[num] == filament_sending_out) // 如果通道刚开始进料
                 {
-                    is_backing_out = false; // 设置无需记录距离
-                    pull_state_old = true; // 首次不会往后拽，会等待触发低电压位，避免刚进入料就被拉出。
-                    filament_now_position[num] = filament_using; // 标记为使用中
-                    time_end = time_now + 1500;                  // 防止未被咬合, 持续进1.5秒
+                    MC_channel.backing_out[num] = false; // 设置无需记录距离
+                    MC_channel.first_use[num] = true; // 首次不会往后拽，会等待触发低电压位，避免刚进入料就被拉出。
+                    MC_channel.position[num] = filament_using; // 标记为使用中
+                    MC_channel.slow_send_end[num] = time_now + 1500; // 防止未被咬合, 持续进1.5秒
+                    Change_planner_finish(num);
                 }
-                else if (filament_now_position[num] == filament_using) // 已经触发且处于使用中
+                else if (MC_channel.position[num] == filament_using) // 已经触发且处于使用中
                 {
-                    last_total_distance[i] = 0; // 重置退料距离
-                    if (time_now > time_end)
+                    MC_channel.retract_distance[num] = 0; // 重置退料距离
+                    if (time_now > MC_channel.slow_send_end[num])
                     {                                          // 已超1.5秒，进入通道使用 进行续料
                         MC_STU_RGB_set(num, 255, 255, 255); // 白色
                         MOTOR_CONTROL[num].set_motion(filament_motion_enum::filament_motion_pressure_ctrl_on_use, 20);
@@ -699,7 +1671,7 @@ void motor_motion_switch() // 通道状态切换函数，只控制当前在使
                 break;
             }
             case AMS_filament_motion::idle:
-                filament_now_position[num] = filament_idle;
+                MC_channel.position[num] = filament_idle;
                 MOTOR_CONTROL[num].set_motion(filament_motion_enum::filament_motion_pressure_ctrl_idle, 100);
                 for (int i = 0; i < 4; i++)
                 {
@@ -722,7 +1694,7 @@ void motor_motion_switch() // 通道状态切换函数，只控制当前在使
         }
         else if (MC_ONLINE_key_stu[num] == 0) // 0:一定没有耗材丝，1:同时触发一定有耗材丝 2:仅外部触发 3:仅内部触发，这里有防掉线功能
         {
-            filament_now_position[num] = filament_idle;
+            MC_channel.position[num] = filament_idle;
             MOTOR_CONTROL[num].set_motion(filament_motion_enum::filament_motion_pressure_ctrl_idle, 100);
             // MC_STU_RGB_set(num, 0, 0, 255);
         }
@@ -741,14 +1713,13 @@ void motor_motion_run(int error)
         // 根据设备类型执行不同的电机控制逻辑
         if (device_type == BambuBus_AMS_lite)
         {
-            motor_motion_switch(); // 调度电机
+            motor_motion_switch(false); // 调度电机
         }
         else if (device_type == BambuBus_AMS)
         {
-            if (!Prepare_For_filament_Pull_Back(P1X_OUT_filament_meters)) // 取反(返回true)，则代表不需要优先考虑退料，并继续调度电机。
-            {
-                motor_motion_switch(); // 调度电机
-            }
+            // 退料和下一通道的预进料重叠进行，由 Change_planner_feed_left 保证安全距离
+            Prepare_For_filament_Pull_Back(P1X_OUT_filament_meters);
+            motor_motion_switch(true); // 调度电机
         }
     }
     else // error模式
@@ -759,9 +1730,21 @@ void motor_motion_run(int error)
 
     for (int i = 0; i < 4; i++)
     {
+        if (MC_channel.position[i] != filament_pulling_back)
+            LED_anim_clear(i, 0, LED_LAYER_PROGRESS); // 不在退料中，去掉进度灯效
         /*if (!get_filament_online(i)) // 通道不在线则电机不允许工作
             MOTOR_CONTROL[i].set_motion(filament_motion_stop, 100);*/
-        MOTOR_CONTROL[i].run(time_E); // 根据状态信息来驱动电机
+        // 打印或换料期间保持等待, 空闲后才开始
+        if (MC_autotune[i].pending && !error && !Autotune_printer_busy() && (MC_channel.position[i] == filament_idle) &&
+            (MC_ONLINE_key_stu[i] != 0) && (MOTOR_CONTROL[i].get_motion() == filament_motion_enum::filament_motion_pressure_ctrl_idle))
+        {
+            MC_autotune[i].pending = false;
+            Motion_control_autotune_start(i, false);
+        }
+        if (Motion_control_autotune_active(i))
+            Motion_control_autotune_run(i, time_E); // 整定期间由继电器测试驱动电机
+        else
+            MOTOR_CONTROL[i].run(time_E); // 根据状态信息来驱动电机
         
         // Update loading direction detection
         if (loading_detection[i].detection_active) {
@@ -794,24 +1777,38 @@ void motor_motion_run(int error)
             MC_PULL_ONLINE_RGB_set(i, 0, 0, 255); // 压力过小，蓝灯
         }
     }
+    Motor_model_save_if_changed();
     time_last = time_now;
 }
-// 运动控制函数
-void Motion_control_run(int error)
+/**
+ * Sample the buffer and presence voltages; the SENSOR task
+ */
+void Motion_control_sample()
 {
+    PROFILE_SCOPE(SENSOR_READ);
     MC_PULL_ONLINE_read();
-
-    AS5600_distance_updata();
+}
+// 运动控制函数, the CONTROL task; error is -1 while the printer is offline
+void Motion_control_run(int error)
+{
+    if (MC_save_pending)
+        Motion_control_save_pending();
+    if (Motion_control_calibrating()) // 启动方向探测还在驱动电机
+        return;
+    {
+        PROFILE_SCOPE(AS5600_UPDATE);
+        AS5600_distance_updata();
+    }
     for (int i = 0; i < 4; i++)
     {
         if (MC_ONLINE_key_stu[i] == 0) {
             set_filament_online(i, false);
         } else if (MC_ONLINE_key_stu[i] == 1) {
             set_filament_online(i, true);
-        } else if (MC_ONLINE_key_stu[i] == 3 && filament_now_position[i] == filament_using) {
+        } else if (MC_ONLINE_key_stu[i] == 3 && MC_channel.position[i] == filament_using) {
             // 如果 仅内侧触发且在使用中，先不离线
             set_filament_online(i, true);
-        } else if (filament_now_position[i] == filament_redetect || (filament_now_position[i] == filament_pulling_back)) {
+        } else if (MC_channel.position[i] == filament_redetect || (MC_channel.position[i] == filament_pulling_back)) {
             // 如果 处于退料返回，或退料中，先不离线
             set_filament_online(i, true);
         } else {
@@ -857,8 +1854,29 @@ void Motion_control_run(int error)
             }
         }
     }
+    PROFILE_SCOPE(MOTOR_RUN);
     motor_motion_run(error);
 }
+/**
+ * True when no channel is driving its motor or moving filament, so sampling can slow down
+ */
+bool Motion_control_idle()
+{
+    if (Motion_control_calibrating())
+        return false;
+    for (int i = 0; i < MAX_FILAMENT_CHANNELS; i++)
+    {
+        filament_motion_enum motion = MOTOR_CONTROL[i].get_motion();
+        if ((motion != filament_motion_enum::filament_motion_pressure_ctrl_idle) &&
+            (motion != filament_motion_enum::filament_motion_stop))
+            return false;
+        if ((Motion_control_pwm[i] != 0) || (fabs(speed_as5600[i]) > 1) || loading_detection[i].detection_active)
+            return false;
+        if (Motion_control_autotune_active(i) || MC_autotune[i].pending)
+            return false;
+    }
+    return true;
+}
 // 设置PWM驱动电机
 void MC_PWM_init()
 {
@@ -995,17 +2013,20 @@ void start_loading_direction_detection(int channel)
     // Test current motor direction first
     state.test_direction = MOTOR_CONTROL[channel].dir;
     
-    #if AUTO_DIRECTION_DEBUG_ENABLED
-    DEBUG_MY("Starting loading direction detection for channel ");
-    DEBUG_float(channel, 0);
-    DEBUG_MY(" testing direction ");
-    DEBUG_float(state.test_direction, 0);
-    DEBUG_MY("\n");
-    #else
-    DEBUG_MY("Loading direction detection started for CH");
-    DEBUG_float(channel, 0);
-    DEBUG_MY("\n");
-    #endif
+    LOG_IF(MOTION, TRACE)
+    {
+        DEBUG_MY("Starting loading direction detection for channel ");
+        DEBUG_float(channel, 0);
+        DEBUG_MY(" testing direction ");
+        DEBUG_float(state.test_direction, 0);
+        DEBUG_MY("\n");
+    }
+    else LOG_IF(MOTION, INFO)
+    {
+        DEBUG_MY("Loading direction detection started for CH");
+        DEBUG_float(channel, 0);
+        DEBUG_MY("\n");
+    }
 }
 
 /**
@@ -1028,11 +2049,12 @@ void update_loading_direction_detection(int channel)
     
     // Check for timeout
     if (current_time - state.detection_start_time > 3000) { // 3 second timeout
-        #if AUTO_DIRECTION_DEBUG_ENABLED
-        DEBUG_MY("Loading direction detection timeout for channel ");
-        DEBUG_float(channel, 0);
-        DEBUG_MY("\n");
-        #endif
+        LOG_IF(MOTION, TRACE)
+        {
+            DEBUG_MY("Loading direction detection timeout for channel ");
+            DEBUG_float(channel, 0);
+            DEBUG_MY("\n");
+        }
         state.detection_active = false;
         return;
     }
@@ -1053,13 +2075,14 @@ void update_loading_direction_detection(int channel)
         // Filament presence lost - this direction is UNLOADING
         state.presence_lost = true;
         
-        #if AUTO_DIRECTION_DEBUG_ENABLED
-        DEBUG_MY("Channel ");
-        DEBUG_float(channel, 0);
-        DEBUG_MY(" direction ");
-        DEBUG_float(state.test_direction, 0);
-        DEBUG_MY(" is UNLOADING (presence lost)\n");
-        #endif
+        LOG_IF(MOTION, TRACE)
+        {
+            DEBUG_MY("Channel ");
+            DEBUG_float(channel, 0);
+            DEBUG_MY(" direction ");
+            DEBUG_float(state.test_direction, 0);
+            DEBUG_MY(" is UNLOADING (presence lost)\n");
+        }
         
         // The opposite direction should be for loading
         state.confirmed_loading_direction = -state.test_direction;
@@ -1068,13 +2091,14 @@ void update_loading_direction_detection(int channel)
     } else if (current_presence && (current_time - state.stable_time > 2000)) {
         // Filament presence maintained for 2+ seconds - this direction is LOADING
         
-        #if AUTO_DIRECTION_DEBUG_ENABLED
-        DEBUG_MY("Channel ");
-        DEBUG_float(channel, 0);
-        DEBUG_MY(" direction ");
-        DEBUG_float(state.test_direction, 0);
-        DEBUG_MY(" is LOADING (presence maintained)\n");
-        #endif
+        LOG_IF(MOTION, TRACE)
+        {
+            DEBUG_MY("Channel ");
+            DEBUG_float(channel, 0);
+            DEBUG_MY(" direction ");
+            DEBUG_float(state.test_direction, 0);
+            DEBUG_MY(" is LOADING (presence maintained)\n");
+        }
         
         state.confirmed_loading_direction = state.test_direction;
         complete_loading_direction_detection(channel);
@@ -1107,19 +2131,22 @@ void complete_loading_direction_detection(int channel)
     Motion_control_data_save.auto_learned[channel] = true;
     MOTOR_CONTROL[channel].dir = loading_dir;
     
-    #if AUTO_DIRECTION_DEBUG_ENABLED
-    DEBUG_MY("Loading direction detection completed for channel ");
-    DEBUG_float(channel, 0);
-    DEBUG_MY(": loading direction=");
-    DEBUG_float(loading_dir, 0);
-    DEBUG_MY("\n");
-    #else
-    DEBUG_MY("Loading direction learned: CH");
-    DEBUG_float(channel, 0);
-    DEBUG_MY(" dir=");
-    DEBUG_float(loading_dir, 0);
-    DEBUG_MY("\n");
-    #endif
+    LOG_IF(MOTION, TRACE)
+    {
+        DEBUG_MY("Loading direction detection completed for channel ");
+        DEBUG_float(channel, 0);
+        DEBUG_MY(": loading direction=");
+        DEBUG_float(loading_dir, 0);
+        DEBUG_MY("\n");
+    }
+    else LOG_IF(MOTION, INFO)
+    {
+        DEBUG_MY("Loading direction learned: CH");
+        DEBUG_float(channel, 0);
+        DEBUG_MY(" dir=");
+        DEBUG_float(loading_dir, 0);
+        DEBUG_MY("\n");
+    }
     
     // Save to flash
     Motion_control_save();
@@ -1173,13 +2200,14 @@ void start_direction_learning(int channel, int commanded_direction)
     state.confidence_score = 0.0f;
     state.has_valid_data = false;
     
-    #if AUTO_DIRECTION_DEBUG_ENABLED
-    DEBUG_MY("Starting direction learning for channel ");
-    DEBUG_float(channel, 0);
-    DEBUG_MY(" with command direction ");
-    DEBUG_float(commanded_direction, 0);
-    DEBUG_MY("\n");
-    #endif
+    LOG_IF(MOTION, TRACE)
+    {
+        DEBUG_MY("Starting direction learning for channel ");
+        DEBUG_float(channel, 0);
+        DEBUG_MY(" with command direction ");
+        DEBUG_float(commanded_direction, 0);
+        DEBUG_MY("\n");
+    }
 }
 
 /**
@@ -1202,11 +2230,12 @@ void update_direction_learning(int channel, float movement_delta)
     
     // Check for timeout
     if (current_time - state.learning_start_time > AUTO_DIRECTION_TIMEOUT_MS) {
-        #if AUTO_DIRECTION_DEBUG_ENABLED
-        DEBUG_MY("Direction learning timeout for channel ");
-        DEBUG_float(channel, 0);
-        DEBUG_MY("\n");
-        #endif
+        LOG_IF(MOTION, TRACE)
+        {
+            DEBUG_MY("Direction learning timeout for channel ");
+            DEBUG_float(channel, 0);
+            DEBUG_MY("\n");
+        }
         state.learning_active = false;
         return;
     }
@@ -1272,23 +2301,24 @@ void update_direction_learning(int channel, float movement_delta)
             state.confidence_score = max_samples / (float)total_directional_samples;
         }
         
-        #if AUTO_DIRECTION_DEBUG_ENABLED
-        DEBUG_MY("Channel ");
-        DEBUG_float(channel, 0);
-        DEBUG_MY(" sample ");
-        DEBUG_float(state.sample_count, 0);
-        DEBUG_MY(": movement=");
-        DEBUG_float(movement_delta, 3);
-        DEBUG_MY(" commanded=");
-        DEBUG_float(state.command_direction, 0);
-        DEBUG_MY(" actual=");
-        DEBUG_float(actual_direction, 0);
-        DEBUG_MY(" match=");
-        DEBUG_MY(directions_match ? "Y" : "N");
-        DEBUG_MY(" confidence=");
-        DEBUG_float(state.confidence_score, 3);
-        DEBUG_MY("\n");
-        #endif
+        LOG_IF(MOTION, TRACE)
+        {
+            DEBUG_MY("Channel ");
+            DEBUG_float(channel, 0);
+            DEBUG_MY(" sample ");
+            DEBUG_float(state.sample_count, 0);
+            DEBUG_MY(": movement=");
+            DEBUG_float(movement_delta, 3);
+            DEBUG_MY(" commanded=");
+            DEBUG_float(state.command_direction, 0);
+            DEBUG_MY(" actual=");
+            DEBUG_float(actual_direction, 0);
+            DEBUG_MY(" match=");
+            DEBUG_MY(directions_match ? "Y" : "N");
+            DEBUG_MY(" confidence=");
+            DEBUG_float(state.confidence_score, 3);
+            DEBUG_MY("\n");
+        }
         
         // Reset movement accumulator for next sample
         state.total_movement = 0.0f;
@@ -1320,24 +2350,26 @@ void complete_direction_learning(int channel)
     
     // Validate that we received meaningful sensor data
     if (!state.has_valid_data) {
-        #if AUTO_DIRECTION_DEBUG_ENABLED
-        DEBUG_MY("Direction learning failed for channel ");
-        DEBUG_float(channel, 0);
-        DEBUG_MY(": no valid sensor data\n");
-        #endif
+        LOG_IF(MOTION, TRACE)
+        {
+            DEBUG_MY("Direction learning failed for channel ");
+            DEBUG_float(channel, 0);
+            DEBUG_MY(": no valid sensor data\n");
+        }
         state.learning_active = false;
         return;
     }
     
     // Require a minimum confidence level
     if (state.confidence_score < AUTO_DIRECTION_CONFIDENCE_THRESHOLD) {
-        #if AUTO_DIRECTION_DEBUG_ENABLED
-        DEBUG_MY("Direction learning failed for channel ");
-        DEBUG_float(channel, 0);
-        DEBUG_MY(": confidence too low: ");
-        DEBUG_float(state.confidence_score, 3);
-        DEBUG_MY("\n");
-        #endif
+        LOG_IF(MOTION, TRACE)
+        {
+            DEBUG_MY("Direction learning failed for channel ");
+            DEBUG_float(channel, 0);
+            DEBUG_MY(": confidence too low: ");
+            DEBUG_float(state.confidence_score, 3);
+            DEBUG_MY("\n");
+        }
         state.learning_active = false;
         return;
     }
@@ -1352,11 +2384,12 @@ void complete_direction_learning(int channel)
         learned_direction = -1;
     } else {
         // Inconclusive results
-        #if AUTO_DIRECTION_DEBUG_ENABLED
-        DEBUG_MY("Direction learning inconclusive for channel ");
-        DEBUG_float(channel, 0);
-        DEBUG_MY(": equal pos/neg samples\n");
-        #endif
+        LOG_IF(MOTION, TRACE)
+        {
+            DEBUG_MY("Direction learning inconclusive for channel ");
+            DEBUG_float(channel, 0);
+            DEBUG_MY(": equal pos/neg samples\n");
+        }
         state.learning_active = false;
         return;
     }
@@ -1367,32 +2400,36 @@ void complete_direction_learning(int channel)
         Motion_control_data_save.auto_learned[channel] = true;
         MOTOR_CONTROL[channel].dir = learned_direction;
         
-        #if AUTO_DIRECTION_DEBUG_ENABLED
-        DEBUG_MY("Direction learning completed for channel ");
-        DEBUG_float(channel, 0);
-        DEBUG_MY(": direction=");
-        DEBUG_float(learned_direction, 0);
-        DEBUG_MY(" confidence=");
-        DEBUG_float(state.confidence_score, 3);
-        DEBUG_MY(" samples=");
-        DEBUG_float(state.sample_count, 0);
-        DEBUG_MY(" pos=");
-        DEBUG_float(state.positive_samples, 0);
-        DEBUG_MY(" neg=");
-        DEBUG_float(state.negative_samples, 0);
-        DEBUG_MY("\n");
-        #else
-        DEBUG_MY("Auto direction learned: CH");
-        DEBUG_float(channel, 0);
-        DEBUG_MY(" dir=");
-        DEBUG_float(learned_direction, 0);
-        DEBUG_MY(" confidence=");
-        DEBUG_float(state.confidence_score, 2);
-        DEBUG_MY("\n");
-        #endif
+        LOG_IF(MOTION, TRACE)
+        {
+            DEBUG_MY("Direction learning completed for channel ");
+            DEBUG_float(channel, 0);
+            DEBUG_MY(": direction=");
+            DEBUG_float(learned_direction, 0);
+            DEBUG_MY(" confidence=");
+            DEBUG_float(state.confidence_score, 3);
+            DEBUG_MY(" samples=");
+            DEBUG_float(state.sample_count, 0);
+            DEBUG_MY(" pos=");
+            DEBUG_float(state.positive_samples, 0);
+            DEBUG_MY(" neg=");
+            DEBUG_float(state.negative_samples, 0);
+            DEBUG_MY("\n");
+        }
+        else LOG_IF(MOTION, INFO)
+        {
+            DEBUG_MY("Auto direction learned: CH");
+            DEBUG_float(channel, 0);
+            DEBUG_MY(" dir=");
+            DEBUG_float(learned_direction, 0);
+            DEBUG_MY(" confidence=");
+            DEBUG_float(state.confidence_score, 2);
+            DEBUG_MY("\n");
+        }
         
         // Save to flash
         Motion_control_save();
+        Motion_control_autotune_request(channel); // 方向确定后再整定 PID
         
         state.learning_complete = true;
     }
@@ -1442,11 +2479,12 @@ void reset_direction_learning(int channel)
     // Save to flash
     Motion_control_save();
     
-    #if AUTO_DIRECTION_DEBUG_ENABLED
-    DEBUG_MY("Direction learning reset for channel ");
-    DEBUG_float(channel, 0);
-    DEBUG_MY("\n");
-    #endif
+    LOG_IF(MOTION, TRACE)
+    {
+        DEBUG_MY("Direction learning reset for channel ");
+        DEBUG_float(channel, 0);
+        DEBUG_MY("\n");
+    }
 }
 
 /**
@@ -1469,9 +2507,10 @@ void reset_all_learned_directions()
     // Save all changes to flash at once
     Motion_control_save();
     
-    #if AUTO_DIRECTION_DEBUG_ENABLED
-    DEBUG_MY("All direction learning data reset\n");
-    #endif
+    LOG_IF(MOTION, TRACE)
+    {
+        DEBUG_MY("All direction learning data reset\n");
+    }
 }
 
 // Convert angle difference, handling wraparound
@@ -1490,10 +2529,70 @@ int M5600_angle_dis(int16_t angle1, int16_t angle2)
 }
 
 // 测试电机运动方向（启动时调用，现在作为自动学习的备用方案）
+/**
+ * Startup direction probe for channels without a known motor direction
+ *
+ * Used when auto-learning is disabled: each new channel's motor is driven
+ * until its AS5600 sees more than 1mm of movement, which gives the sign of
+ * the direction. This used to block setup() for up to 2s; it now runs as a
+ * state machine from the main loop (MOTOR_dir_probe_run) while BambuBus is
+ * already answering, and motor control waits for it to finish.
+ */
+enum class MOTOR_dir_probe_state
+{
+    idle,
+    running,
+    done,
+};
+struct
+{
+    MOTOR_dir_probe_state state = MOTOR_dir_probe_state::idle;
+    bool need_startup_calibration;
+    bool need_save;
+    uint64_t start_time;
+    uint64_t poll_time;
+    int16_t last_angle[4];
+    int dir[4];
+} MOTOR_dir_probe;
+
+void MOTOR_apply_dir();
+
+void MOTOR_dir_probe_finish()
+{
+    int *dir = MOTOR_dir_probe.dir;
+    if (MOTOR_dir_probe.need_startup_calibration)
+    {
+        // Apply static motor direction corrections when auto-learning is disabled
+        static const bool motor_dir_correction[4] = {
+            MOTOR_DIR_CORRECTION_CH0,  // Channel 0
+            MOTOR_DIR_CORRECTION_CH1,  // Channel 1 (commonly reversed)
+            MOTOR_DIR_CORRECTION_CH2,  // Channel 2 (commonly reversed)
+            MOTOR_DIR_CORRECTION_CH3   // Channel 3 (sometimes reversed)
+        };
+
+        for (int index = 0; index < 4; index++) // 遍历四个电机
+        {
+            // Apply direction correction if needed for this channel
+            if (motor_dir_correction[index] && dir[index] != 0) {
+                dir[index] = -dir[index]; // Invert the detected direction
+            }
+            Motion_control_data_save.Motion_control_dir[index] = dir[index]; // 数据复制
+            Motion_control_data_save.auto_learned[index] = false; // Mark as static correction
+        }
+    }
+
+    if (MOTOR_dir_probe.need_save) // 如果需要保存数据
+    {
+        Motion_control_save(); // 数据保存
+    }
+    MOTOR_dir_probe.state = MOTOR_dir_probe_state::done;
+    MOTOR_apply_dir();
+    Boot_mark(BOOT_DIR_PROBE_DONE);
+}
+
 void MOTOR_get_dir()
 {
-    int dir[4] = {0, 0, 0, 0};
-    bool done = false;
+    int *dir = MOTOR_dir_probe.dir;
     bool have_data = Motion_control_read();
     if (!have_data)
     {
@@ -1515,10 +2614,9 @@ void MOTOR_get_dir()
     
     MC_AS5600.updata_angle(); //读取5600的初始角度值
 
-    int16_t last_angle[4];
     for (int index = 0; index < 4; index++)
     {
-        last_angle[index] = MC_AS5600.raw_angle[index];                  //将初始角度值记录下来
+        MOTOR_dir_probe.last_angle[index] = MC_AS5600.raw_angle[index];  //将初始角度值记录下来
         dir[index] = Motion_control_data_save.Motion_control_dir[index]; //记录flash中的dir数据
     }
     
@@ -1540,6 +2638,7 @@ void MOTOR_get_dir()
     }
     
     bool need_save = false; // 是否需要更新状态
+    bool need_probe = false;
     
     if (need_startup_calibration) {
         for (int index = 0; index < 4; index++)
@@ -1550,6 +2649,7 @@ void MOTOR_get_dir()
                 {
                     Motion_control_set_PWM(index, 1000); // 打开电机
                     need_save = true;                    // 有状态更新
+                    need_probe = true;
                 }
             }
             else
@@ -1558,75 +2658,86 @@ void MOTOR_get_dir()
                 need_save = true; // 有状态更新
             }
         }
-        
-        int i = 0;
-        while (done == false)
-        {
-            done = true;
+    }
+
+    MOTOR_dir_probe.need_startup_calibration = need_startup_calibration;
+    MOTOR_dir_probe.need_save = need_save;
+    if (need_probe)
+    {
+        MOTOR_dir_probe.start_time = get_time64();
+        MOTOR_dir_probe.poll_time = MOTOR_dir_probe.start_time;
+        MOTOR_dir_probe.state = MOTOR_dir_probe_state::running; // 在主循环中等待电机转动
+    }
+    else
+    {
+        MOTOR_dir_probe_finish();
+    }
+}
 
-            delay(10);                // 间隔10ms检测一次
-            MC_AS5600.updata_angle(); // 更新角度数据
+// One step of the direction probe; call from the main loop
+void MOTOR_dir_probe_run()
+{
+    if (MOTOR_dir_probe.state != MOTOR_dir_probe_state::running)
+        return;
+    uint64_t now = get_time64();
+    if (now - MOTOR_dir_probe.poll_time < 10) // 间隔10ms检测一次
+        return;
+    MOTOR_dir_probe.poll_time = now;
+    MC_AS5600.updata_angle(); // 更新角度数据
 
-            if (i++ > 200) // 超过2s无响应
+    if (now - MOTOR_dir_probe.start_time > 2000) // 超过2s无响应
+    {
+        for (int index = 0; index < 4; index++)
+        {
+            Motion_control_set_PWM(index, 0); // 停止
+        }
+        MOTOR_dir_probe_finish();
+        return;
+    }
+    bool done = true;
+    for (int index = 0; index < 4; index++) // 遍历
+    {
+        if ((MC_AS5600.online[index] == true) && (Motion_control_data_save.Motion_control_dir[index] == 0) &&
+            (MOTOR_dir_probe.dir[index] == 0)) // 对于新的通道
+        {
+            int angle_dis = M5600_angle_dis(MC_AS5600.raw_angle[index], MOTOR_dir_probe.last_angle[index]);
+            if (abs(angle_dis) > 163) // 移动超过1mm
             {
-                for (int index = 0; index < 4; index++)
+                Motion_control_set_PWM(index, 0); // 停止
+                if (angle_dis > 0)                // 这里AS600正对着磁铁，和背贴方向是反的
                 {
-                    Motion_control_set_PWM(index, 0);                       // 停止
-                    Motion_control_data_save.Motion_control_dir[index] = 0; // 方向设为0
+                    MOTOR_dir_probe.dir[index] = 1;
                 }
-                break; // 跳出循环
-            }
-            for (int index = 0; index < 4; index++) // 遍历
-            {
-                if ((MC_AS5600.online[index] == true) && (Motion_control_data_save.Motion_control_dir[index] == 0)) // 对于新的通道
+                else
                 {
-                    int angle_dis = M5600_angle_dis(MC_AS5600.raw_angle[index], last_angle[index]);
-                    if (abs(angle_dis) > 163) // 移动超过1mm
-                    {
-                        Motion_control_set_PWM(index, 0); // 停止
-                        if (angle_dis > 0)                // 这里AS600正对着磁铁，和背贴方向是反的
-                        {
-                            dir[index] = 1;
-                        }
-                        else
-                        {
-                            dir[index] = -1;
-                        }
-                    }
-                    else
-                    {
-                        done = false; // 没有移动。继续等待
-                    }
+                    MOTOR_dir_probe.dir[index] = -1;
                 }
             }
-        }
-        
-        // Apply static motor direction corrections when auto-learning is disabled
-        static const bool motor_dir_correction[4] = {
-            MOTOR_DIR_CORRECTION_CH0,  // Channel 0
-            MOTOR_DIR_CORRECTION_CH1,  // Channel 1 (commonly reversed)
-            MOTOR_DIR_CORRECTION_CH2,  // Channel 2 (commonly reversed)
-            MOTOR_DIR_CORRECTION_CH3   // Channel 3 (sometimes reversed)
-        };
-        
-        for (int index = 0; index < 4; index++) // 遍历四个电机
-        {
-            // Apply direction correction if needed for this channel
-            if (motor_dir_correction[index] && dir[index] != 0) {
-                dir[index] = -dir[index]; // Invert the detected direction
+            else
+            {
+                done = false; // 没有移动。继续等待
             }
-            Motion_control_data_save.Motion_control_dir[index] = dir[index]; // 数据复制
-            Motion_control_data_save.auto_learned[index] = false; // Mark as static correction
         }
     }
-    
-    if (need_save) // 如果需要保存数据
-    {
-        Motion_control_save(); // 数据保存
-    }
+    if (done)
+        MOTOR_dir_probe_finish();
+}
+
+/**
+ * @return true while startup calibration still owns the motors
+ */
+bool Motion_control_calibrating()
+{
+    return MOTOR_dir_probe.state != MOTOR_dir_probe_state::done;
+}
+
+/**
+ * Background startup tasks; the CALIBRATION task
+ */
+void Motion_control_calibration_run()
+{
+    MOTOR_dir_probe_run();
 }
-// 初始化电机
-// 指定方向
 int first_boot = 1; // 1 表示第一次启动，用于执行仅启动时.
 void set_motor_directions(int dir0, int dir1, int dir2, int dir3)
 {
@@ -1645,9 +2756,11 @@ void MOTOR_init()
     GPIO_PinRemapConfig(GPIO_Remap_PD01, ENABLE);
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOC | RCC_APB2Periph_GPIOD, ENABLE);
     MC_AS5600.init(AS5600_SCL, AS5600_SDA, MAX_FILAMENT_CHANNELS);
+    Boot_mark(BOOT_AS5600_INIT);
     // MOTOR_get_pwm_zero();
-    // 自动方向检测（包含硬件差异修正）
+    // 自动方向检测（包含硬件差异修正）, 需要转动电机时在主循环中完成
     MOTOR_get_dir();
+    Boot_mark(BOOT_MOTOR_DIR);
 
     // 固定电机方向用 - 仅在需要覆盖自动检测时使用
     // 注意：现在自动检测已包含对通道1和2的方向修正
@@ -1661,6 +2774,11 @@ void MOTOR_init()
         
         first_boot = 0;
     }
+}
+
+// Set up the motor controllers with the directions found by MOTOR_get_dir
+void MOTOR_apply_dir()
+{
     for (int index = 0; index < 4; index++)
     {
         Motion_control_set_PWM(index, 0);
@@ -1678,15 +2796,18 @@ void MOTOR_init()
     }
     
     // Debug: Print motor directions being initialized
-    DEBUG_MY("Motor directions set: CH0=");
-    DEBUG_MY(MOTOR_CONTROL[0].dir > 0 ? "+" : "-");
-    DEBUG_MY(" CH1=");  
-    DEBUG_MY(MOTOR_CONTROL[1].dir > 0 ? "+" : "-");
-    DEBUG_MY(" CH2=");
-    DEBUG_MY(MOTOR_CONTROL[2].dir > 0 ? "+" : "-");
-    DEBUG_MY(" CH3=");
-    DEBUG_MY(MOTOR_CONTROL[3].dir > 0 ? "+" : "-");
-    DEBUG_MY("\n");
+    LOG_IF(MOTION, INFO)
+    {
+        DEBUG_MY("Motor directions set: CH0=");
+        DEBUG_MY(MOTOR_CONTROL[0].dir > 0 ? "+" : "-");
+        DEBUG_MY(" CH1=");
+        DEBUG_MY(MOTOR_CONTROL[1].dir > 0 ? "+" : "-");
+        DEBUG_MY(" CH2=");
+        DEBUG_MY(MOTOR_CONTROL[2].dir > 0 ? "+" : "-");
+        DEBUG_MY(" CH3=");
+        DEBUG_MY(MOTOR_CONTROL[3].dir > 0 ? "+" : "-");
+        DEBUG_MY("\n");
+    }
     
     // Save any updated motor directions to flash
     Motion_control_save();
@@ -1710,28 +2831,12 @@ void MOTOR_init()
 extern void RGB_update();
 void Motion_control_init() // 初始化所有运动和传感器
 {
+    Motion_control_tuning_load();
+    Motor_model_load();
     MC_PULL_ONLINE_init();
+    Boot_mark(BOOT_ADC_INIT);
     MC_PULL_ONLINE_read();
     MOTOR_init();
-    
-    /*
-    //这是一段阻塞的DEBUG代码
-    while (1)
-    {
-        delay(10);
-        MC_PULL_ONLINE_read();
-
-        for (int i = 0; i < 4; i++)
-        {
-            MOTOR_CONTROL[i].set_motion(filament_motion_pressure_ctrl_on_use, 100);
-            if (!get_filament_online(i)) // 通道不在线则电机不允许工作
-                MOTOR_CONTROL[i].set_motion(filament_motion_stop, 100);
-            MOTOR_CONTROL[i].run(0); // 根据状态信息来驱动电机
-        }
-        char s[100];
-        int n = sprintf(s, "%d\n", (int)(MC_PULL_stu_raw[3] * 1000));
-        DEBUG_num(s, n);
-    }*/
 
     for (int i = 0; i < 4; i++)
     {
@@ -1743,6 +2848,6 @@ void Motion_control_init() // 初始化所有运动和传感器
         // {
         //     filament_channel_inserted[i]=false;
         // }
-        filament_now_position[i] = filament_idle;//将通道初始状态设置为空闲
+        MC_channel.position[i] = filament_idle;//将通道初始状态设置为空闲
     }
 }
@@ -1,10 +1,54 @@
 #pragma once
 
 #include "main.h"
+#include "config.h"
 
 extern void Motion_control_init();
 extern void Motion_control_set_PWM(uint8_t CHx, int PWM);
+extern void Motion_control_sample();
 extern void Motion_control_run(int error);
+extern void Motion_control_calibration_run();
+extern bool Motion_control_calibrating();
+extern bool Motion_control_idle();
+extern void Motion_control_change_stats(uint32_t *last_ms, uint32_t *overlap_ms, uint32_t *count);
+
+/**
+ * Runtime-tunable control parameters, defaults from config.h
+ * Stored in flash as one record, so only append fields and bump the version.
+ */
+struct Motion_control_tuning_struct
+{
+    float speed_P;              ///< Speed loop PID
+    float speed_I;
+    float speed_D;
+    float pressure_P;           ///< Buffer pressure loop PID
+    float pressure_I;
+    float pressure_D;
+    float pull_voltage_high;    ///< Buffer over-compressed above this (V)
+    float pull_voltage_low;     ///< Buffer slack below this (V)
+    float pull_voltage_send_max; ///< AMS lite feeds fast below this (V)
+    float pull_target_low;      ///< In use: AMS lite holds the buffer midway between low and high, AMS feeds below low (V)
+    float pull_target_high;     ///< In use: AMS pulls back above high (V)
+    uint32_t assist_send_time_ms; ///< Feed assist duration after the outer switch triggers
+    float buffer_mm_per_v;      ///< AMS lite in use: filament taken up by the buffer per volt of slider travel
+};
+extern Motion_control_tuning_struct MC_tuning;
+extern void Motion_control_tuning_apply();
+extern void Motion_control_tuning_defaults();
+extern bool Motion_control_tuning_save();
+extern void Motion_control_model_reset();
+extern bool Motion_control_model_get(int CHx, float *breakaway, float *offset, float *gain, int *samples);
+extern bool Motion_control_autotune_start(int CHx, bool pressure);
+extern bool Motion_control_autotune_active(int CHx);
+extern int Motion_control_autotune_status(int CHx, bool *pressure, float *P, float *I);
+extern void Motion_control_autotune_clear();
+
+// Latest sensor readings and outputs, per channel
+extern class AS5600_soft_IIC_many MC_AS5600;
+extern float MC_PULL_stu_raw[MAX_FILAMENT_CHANNELS];       ///< Buffer slider voltage
+extern float MC_ONLINE_key_stu_raw[MAX_FILAMENT_CHANNELS]; ///< Presence switch voltage
+extern float speed_as5600[MAX_FILAMENT_CHANNELS];          ///< Filament speed from the AS5600, mm/s
+extern int16_t Motion_control_pwm[MAX_FILAMENT_CHANNELS];  ///< Last PWM passed to Motion_control_set_PWM
 
 // Automatic direction learning functions
 extern void start_direction_learning(int channel, int commanded_direction);
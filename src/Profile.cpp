@@ -0,0 +1,107 @@
+#include "Profile.h"
+#include <stdio.h>
+#include <string.h>
+
+#if PROFILE_ENABLED
+
+#ifdef ARDUINO_ARCH_CH32
+#include "main.h"
+uint32_t Profile_now_us()
+{
+    return micros();
+}
+#define Profile_print(text) DEBUG_MY(text)
+#else
+#include "Host.h"
+uint32_t Profile_now_us()
+{
+    return micros();
+}
+#define Profile_print(text) Host_print(text)
+#endif
+
+Profile_stat Profile_stats[PROFILE_SLOT_COUNT];
+
+const char *const Profile_names[PROFILE_SLOT_COUNT] = {
+#define PROFILE_SLOT_NAME(name) #name,
+    PROFILE_SLOT_TABLE(PROFILE_SLOT_NAME)
+#undef PROFILE_SLOT_NAME
+};
+
+void Profile_add(Profile_slot slot, uint32_t elapsed_us)
+{
+    Profile_stat &stat = Profile_stats[slot];
+    if ((stat.count == 0) || (elapsed_us < stat.min_us))
+        stat.min_us = elapsed_us;
+    if (elapsed_us > stat.max_us)
+        stat.max_us = elapsed_us;
+    stat.total_us += elapsed_us;
+    stat.count++;
+}
+
+const Profile_stat *Profile_get(Profile_slot slot)
+{
+    return (slot < PROFILE_SLOT_COUNT) ? &Profile_stats[slot] : NULL;
+}
+
+const char *Profile_name(Profile_slot slot)
+{
+    return (slot < PROFILE_SLOT_COUNT) ? Profile_names[slot] : "?";
+}
+
+void Profile_reset()
+{
+    memset(Profile_stats, 0, sizeof(Profile_stats));
+}
+
+/**
+ * One line per slot: name count min mean max total, times in us.
+ * share is the slot's total as a per-mille of LOOP's total.
+ */
+void Profile_dump()
+{
+    char buf[96];
+    uint64_t loop_total = Profile_stats[PROFILE_LOOP].total_us;
+    Profile_print("OK profile slot count min_us mean_us max_us total_us share_permille\n");
+    for (int i = 0; i < PROFILE_SLOT_COUNT; i++)
+    {
+        const Profile_stat &stat = Profile_stats[i];
+        uint32_t mean = stat.count ? (uint32_t)(stat.total_us / stat.count) : 0;
+        uint32_t share = loop_total ? (uint32_t)(stat.total_us * 1000 / loop_total) : 0;
+        sprintf(buf, "OK %s %lu %lu %lu %lu %lu %lu\n", Profile_names[i], (unsigned long)stat.count,
+                (unsigned long)stat.min_us, (unsigned long)mean, (unsigned long)stat.max_us,
+                (unsigned long)stat.total_us, (unsigned long)share);
+        Profile_print(buf);
+    }
+}
+
+#else
+
+uint32_t Profile_now_us()
+{
+    return 0;
+}
+
+void Profile_add(Profile_slot slot, uint32_t elapsed_us)
+{
+}
+
+const Profile_stat *Profile_get(Profile_slot slot)
+{
+    return NULL;
+}
+
+const char *Profile_name(Profile_slot slot)
+{
+    return "";
+}
+
+void Profile_reset()
+{
+}
+
+void Profile_dump()
+{
+}
+
+#endif
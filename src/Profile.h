@@ -0,0 +1,73 @@
+#pragma once
+
+#include "config.h"
+#include <stdint.h>
+
+/**
+ * Hot-path profiler
+ *
+ * PROFILE_SCOPE(slot) times the rest of the enclosing block and folds the
+ * result into that slot's count/min/max/total. Slots are fixed, so there is
+ * no allocation and no lookup; a sample costs two clock reads and a few
+ * adds. With PROFILE_ENABLED at 0 the macros expand to nothing.
+ *
+ * Times are microseconds from micros(); on a PC that is the simulated clock
+ * in Host.cpp, so test/test_profile can check the statistics exactly.
+ */
+#define PROFILE_SLOT_TABLE(X) \
+    X(LOOP)                   \
+    X(BUS_RUN)                \
+    X(FLASH_RUN)              \
+    X(SENSOR_READ)            \
+    X(AS5600_UPDATE)          \
+    X(MOTOR_RUN)              \
+    X(TELEMETRY)              \
+    X(CONSOLE)                \
+    X(LED_ANIM)               \
+    X(LED_FLUSH)
+
+enum Profile_slot : uint8_t
+{
+#define PROFILE_SLOT_ENUM(name) PROFILE_##name,
+    PROFILE_SLOT_TABLE(PROFILE_SLOT_ENUM)
+#undef PROFILE_SLOT_ENUM
+    PROFILE_SLOT_COUNT
+};
+
+struct Profile_stat
+{
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;
+};
+
+extern uint32_t Profile_now_us();
+extern void Profile_add(Profile_slot slot, uint32_t elapsed_us);
+extern const Profile_stat *Profile_get(Profile_slot slot);
+extern const char *Profile_name(Profile_slot slot);
+extern void Profile_reset();
+extern void Profile_dump();
+
+#if PROFILE_ENABLED
+
+class Profile_scope
+{
+public:
+    explicit Profile_scope(Profile_slot slot) : slot(slot), start(Profile_now_us()) {}
+    ~Profile_scope() { Profile_add(slot, Profile_now_us() - start); }
+
+private:
+    Profile_slot slot;
+    uint32_t start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(slot) Profile_scope PROFILE_CONCAT(_profile_scope_, __LINE__)(PROFILE_##slot)
+
+#else
+
+#define PROFILE_SCOPE(slot) do {} while(0)
+
+#endif
@@ -0,0 +1,155 @@
+#include "Scheduler.h"
+#include <stdio.h>
+#include <string.h>
+
+struct Sched_task
+{
+    void (*run)();
+    uint8_t priority;
+    uint32_t deadline_us;
+};
+
+const Sched_task Sched_tasks[SCHED_TASK_COUNT] = {
+#define SCHED_TASK_ENTRY(name, priority, period_ms, deadline_us) \
+    {Sched_task_##name, priority, deadline_us},
+    SCHED_TASK_TABLE(SCHED_TASK_ENTRY)
+#undef SCHED_TASK_ENTRY
+};
+
+const char *const Sched_names[SCHED_TASK_COUNT] = {
+#define SCHED_TASK_NAME(name, priority, period_ms, deadline_us) #name,
+    SCHED_TASK_TABLE(SCHED_TASK_NAME)
+#undef SCHED_TASK_NAME
+};
+
+volatile bool Sched_posted[SCHED_TASK_COUNT]; // one byte per task, so interrupts never race the main loop
+uint32_t Sched_period_us[SCHED_TASK_COUNT] = {
+#define SCHED_TASK_PERIOD(name, priority, period_ms, deadline_us) (period_ms) * 1000UL,
+    SCHED_TASK_TABLE(SCHED_TASK_PERIOD)
+#undef SCHED_TASK_PERIOD
+};
+uint32_t Sched_next_us[SCHED_TASK_COUNT];
+Sched_stat Sched_stats[SCHED_TASK_COUNT];
+uint64_t Sched_sleep_us = 0;
+uint32_t Sched_sleeps = 0;
+uint64_t Sched_window_start = 0; // ms
+
+void Sched_post(Sched_task_id task)
+{
+    Sched_posted[task] = true;
+}
+
+/**
+ * Change a task's period; 0 leaves it event only. Takes effect from now,
+ * a shorter period does not wait out the old one.
+ */
+void Sched_set_period(Sched_task_id task, uint32_t period_ms)
+{
+    uint32_t period_us = period_ms * 1000;
+    if (Sched_period_us[task] == period_us)
+        return;
+    Sched_period_us[task] = period_us;
+    Sched_next_us[task] = micros() + period_us;
+}
+
+/**
+ * Run the highest priority ready task, if any
+ * @return true if a task ran
+ */
+bool Sched_run()
+{
+    uint32_t now = micros();
+    int task = -1;
+    for (int i = 0; i < SCHED_TASK_COUNT; i++)
+    {
+        bool due = Sched_period_us[i] && ((int32_t)(now - Sched_next_us[i]) >= 0);
+        if ((due || Sched_posted[i]) && ((task < 0) || (Sched_tasks[i].priority < Sched_tasks[task].priority)))
+            task = i;
+    }
+    if (task < 0)
+        return false;
+
+    const Sched_task &t = Sched_tasks[task];
+    Sched_stat &stat = Sched_stats[task];
+    uint32_t period = Sched_period_us[task];
+    uint32_t release = now;
+    if (period && ((int32_t)(now - Sched_next_us[task]) >= 0))
+    {
+        release = Sched_next_us[task];
+        Sched_next_us[task] += period;
+        if ((int32_t)(now - Sched_next_us[task]) >= 0) // a whole period behind, don't burst to catch up
+        {
+            stat.skipped += (now - Sched_next_us[task]) / period + 1;
+            Sched_next_us[task] = now + period;
+        }
+    }
+    Sched_posted[task] = false; // cleared before running, so a post from inside the task runs it again
+
+    t.run();
+
+    uint32_t end = micros();
+    uint32_t elapsed = end - now;
+    stat.runs++;
+    stat.busy_us += elapsed;
+    if (elapsed > stat.max_us)
+        stat.max_us = elapsed;
+    if (end - release > t.deadline_us)
+        stat.overruns++;
+    return true;
+}
+
+/**
+ * Nothing is ready: sleep until the next interrupt. A post that lands between
+ * the scan in Sched_run() and the WFI waits for the next tick at most.
+ */
+void Sched_idle()
+{
+#if SCHED_IDLE_WFI
+    uint32_t start = micros();
+    __WFI();
+    Sched_sleep_us += micros() - start;
+    Sched_sleeps++;
+#endif
+}
+
+const Sched_stat *Sched_get(Sched_task_id task)
+{
+    return (task < SCHED_TASK_COUNT) ? &Sched_stats[task] : NULL;
+}
+
+void Sched_reset()
+{
+    memset(Sched_stats, 0, sizeof(Sched_stats));
+    Sched_sleep_us = 0;
+    Sched_sleeps = 0;
+    Sched_window_start = get_time64();
+}
+
+/**
+ * One line per task: name runs overruns skipped max_us mean_us load_permille,
+ * then the total load and the time asleep in WFI since the last reset
+ */
+void Sched_dump()
+{
+#ifdef Debug_log_on
+    char buf[96];
+    uint64_t window_ms = get_time64() - Sched_window_start;
+    uint64_t busy = 0;
+    Debug_log_write("OK tasks name runs overruns skipped max_us mean_us load_permille\n");
+    for (int i = 0; i < SCHED_TASK_COUNT; i++)
+    {
+        const Sched_stat &stat = Sched_stats[i];
+        uint32_t mean = stat.runs ? (uint32_t)(stat.busy_us / stat.runs) : 0;
+        uint32_t load = window_ms ? (uint32_t)(stat.busy_us / window_ms) : 0;
+        sprintf(buf, "OK %s %lu %lu %lu %lu %lu %lu\n", Sched_names[i], (unsigned long)stat.runs,
+                (unsigned long)stat.overruns, (unsigned long)stat.skipped, (unsigned long)stat.max_us,
+                (unsigned long)mean, (unsigned long)load);
+        Debug_log_write(buf);
+        busy += stat.busy_us;
+    }
+    sprintf(buf, "OK load_permille=%lu sleep_permille=%lu sleeps=%lu window_ms=%lu\n",
+            (unsigned long)(window_ms ? busy / window_ms : 0), (unsigned long)(window_ms ? Sched_sleep_us / window_ms : 0),
+            (unsigned long)Sched_sleeps, (unsigned long)window_ms);
+    Debug_log_write(buf);
+#endif
+}
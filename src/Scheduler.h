@@ -0,0 +1,66 @@
+#pragma once
+
+#include "main.h"
+#include "config.h"
+
+/**
+ * Cooperative run-to-completion scheduler
+ *
+ * Every task in the table below is a plain function that returns quickly.
+ * A task becomes ready when its period elapses (period 0 = event only) or
+ * when Sched_post() is called for it, which is safe from interrupts. Each
+ * Sched_run() runs at most one ready task, the one with the lowest priority
+ * number, so a pending bus packet never waits behind more than one task.
+ *
+ * A run that finishes more than deadline_us after the task was released (the
+ * time it became due) counts as an overrun; a periodic task that falls a whole
+ * period behind skips the missed releases instead of bursting. The `tasks`
+ * console command prints the per-task statistics and the CPU load.
+ *
+ * When nothing is ready, Sched_idle() sleeps in WFI until the next interrupt:
+ * the 1 kHz millis() tick, a bus or console byte, or a DMA transfer. Periods
+ * can be changed at runtime with Sched_set_period(), so quiet tasks stretch
+ * their periods and the core sleeps for most of each tick.
+ *
+ * Task functions are Sched_task_<NAME>(), defined in main.cpp.
+ */
+#define SCHED_TASK_TABLE(X)                                     \
+    /* name, priority, period_ms, deadline_us */                \
+    X(BUS, 0, 10, 2000)                                         \
+    X(SENSOR, 1, SENSOR_PERIOD_MS, 1000)                        \
+    X(CONTROL, 2, CONTROL_PERIOD_MS, 3000)                      \
+    X(CALIBRATION, 3, 10, 2000)                                 \
+    X(CONSOLE, 4, 0, 10000)                                     \
+    X(TELEMETRY, 4, TELEMETRY_RATE_HZ ? 1 : 0, 1000)            \
+    X(LED, 5, 1000 / LED_REFRESH_HZ, 5000)                      \
+    X(FLASH, 6, 1, 10000)                                       \
+    X(HOUSEKEEPING, 7, 100, 50000)
+
+enum Sched_task_id : uint8_t
+{
+#define SCHED_TASK_ENUM(name, priority, period_ms, deadline_us) SCHED_##name,
+    SCHED_TASK_TABLE(SCHED_TASK_ENUM)
+#undef SCHED_TASK_ENUM
+    SCHED_TASK_COUNT
+};
+
+#define SCHED_TASK_DECLARE(name, priority, period_ms, deadline_us) extern void Sched_task_##name();
+SCHED_TASK_TABLE(SCHED_TASK_DECLARE)
+#undef SCHED_TASK_DECLARE
+
+struct Sched_stat
+{
+    uint32_t runs;
+    uint32_t overruns; ///< Finished later than the deadline
+    uint32_t skipped;  ///< Periodic releases dropped because the task fell behind
+    uint32_t max_us;   ///< Longest single run
+    uint64_t busy_us;
+};
+
+extern void Sched_post(Sched_task_id task);
+extern void Sched_set_period(Sched_task_id task, uint32_t period_ms);
+extern bool Sched_run();
+extern void Sched_idle();
+extern const Sched_stat *Sched_get(Sched_task_id task);
+extern void Sched_reset();
+extern void Sched_dump();
@@ -0,0 +1,93 @@
+#include "Telemetry.h"
+
+#if DEBUG_TRACE_ENABLED
+
+static_assert(TELEMETRY_RATE_HZ <= TELEMETRY_MAX_RATE_HZ, "TELEMETRY_RATE_HZ is above TELEMETRY_MAX_RATE_HZ");
+
+static constexpr uint32_t Telemetry_period(uint32_t rate_hz)
+{
+    return rate_hz ? 1000000 / rate_hz : 0;
+}
+
+uint32_t Telemetry_period_us = Telemetry_period(TELEMETRY_RATE_HZ);
+uint32_t Telemetry_next_us = 0;
+
+/**
+ * Change the sample rate at runtime
+ * @param rate_hz Samples per second, 0 stops telemetry; clamped to TELEMETRY_MAX_RATE_HZ
+ */
+void Telemetry_set_rate(uint16_t rate_hz)
+{
+    if (rate_hz > TELEMETRY_MAX_RATE_HZ)
+        rate_hz = TELEMETRY_MAX_RATE_HZ;
+    Telemetry_period_us = Telemetry_period(rate_hz);
+    Telemetry_next_us = micros();
+    Sched_set_period(SCHED_TELEMETRY, rate_hz ? 1 : 0); // polled every tick while on, never while off
+}
+
+uint16_t Telemetry_get_rate()
+{
+    return Telemetry_period(Telemetry_period_us);
+}
+
+static uint16_t Telemetry_mv(float volt)
+{
+    if (volt <= 0)
+        return 0;
+    return volt * 1000 + 0.5f;
+}
+
+static int16_t Telemetry_speed(float speed)
+{
+    float x = speed * 100;
+    if (x > INT16_MAX)
+        return INT16_MAX;
+    if (x < INT16_MIN)
+        return INT16_MIN;
+    return (int16_t)x;
+}
+
+/**
+ * Sample and queue one frame when the period has elapsed. Values are the
+ * latest ones produced by the sensor code, so the effective rate of each
+ * signal is also bounded by how often the main loop refreshes it.
+ */
+void Telemetry_run()
+{
+    if (!Telemetry_period_us)
+        return;
+    uint32_t now = micros();
+    if ((int32_t)(now - Telemetry_next_us) < 0)
+        return;
+    Telemetry_next_us += Telemetry_period_us;
+    if ((int32_t)(now - Telemetry_next_us) >= 0) // fell behind, don't burst to catch up
+        Telemetry_next_us = now + Telemetry_period_us;
+
+    Telemetry_frame frame;
+    for (int i = 0; i < MAX_FILAMENT_CHANNELS; i++)
+    {
+        frame.channel[i].pull_mv = Telemetry_mv(MC_PULL_stu_raw[i]);
+        frame.channel[i].online_mv = Telemetry_mv(MC_ONLINE_key_stu_raw[i]);
+        frame.channel[i].angle = MC_AS5600.raw_angle[i];
+        frame.channel[i].speed = Telemetry_speed(speed_as5600[i]);
+        frame.channel[i].pwm = Motion_control_pwm[i];
+    }
+    TRACE_STRUCT(TELEMETRY, frame);
+}
+
+#else
+
+void Telemetry_set_rate(uint16_t rate_hz)
+{
+}
+
+uint16_t Telemetry_get_rate()
+{
+    return 0;
+}
+
+void Telemetry_run()
+{
+}
+
+#endif
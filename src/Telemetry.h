@@ -0,0 +1,33 @@
+#pragma once
+
+#include "main.h"
+#include "config.h"
+
+/**
+ * Live sensor telemetry
+ *
+ * At a fixed rate, one TELEMETRY trace frame carries the buffer and presence
+ * voltages, AS5600 angle, speed and commanded PWM of all four channels. The
+ * frame is queued in the debug log ring like any other trace event and sent
+ * by DMA; record it with scripts/telemetry_capture.py.
+ *
+ * Needs DEBUG_TRACE_ENABLED; without it the calls compile to nothing.
+ */
+#pragma pack(push, 1)
+struct Telemetry_channel
+{
+    uint16_t pull_mv;   ///< MC_PULL_stu_raw, mV
+    uint16_t online_mv; ///< MC_ONLINE_key_stu_raw, mV
+    uint16_t angle;     ///< AS5600 raw angle (0..4095)
+    int16_t speed;      ///< speed_as5600, 0.01 mm/s
+    int16_t pwm;        ///< Last commanded PWM (-1000..1000)
+};
+struct Telemetry_frame
+{
+    Telemetry_channel channel[MAX_FILAMENT_CHANNELS];
+};
+#pragma pack(pop)
+
+extern void Telemetry_set_rate(uint16_t rate_hz);
+extern uint16_t Telemetry_get_rate();
+extern void Telemetry_run();
@@ -0,0 +1,32 @@
+#include "Trace.h"
+
+#if DEBUG_TRACE_ENABLED
+
+/**
+ * Complete a frame built by Trace_emit() and queue it. The whole frame is
+ * reserved in the log ring at once, so frames from interrupts never split
+ * one another; a frame that does not fit is dropped like any other message.
+ */
+void Trace_send(uint8_t *frame, int args_length)
+{
+    uint32_t t_us = micros();
+    frame[0] = TRACE_SYNC0;
+    frame[1] = TRACE_SYNC1;
+    memcpy(&frame[4], &t_us, 4);
+    uint8_t sum = 0;
+    for (int i = 2; i < 8 + args_length; i++)
+        sum += frame[i];
+    frame[8 + args_length] = (uint8_t)-sum;
+    Debug_log_write_num(frame, 8 + args_length + 1);
+}
+
+void Trace_write(uint8_t id, const void *args, int length)
+{
+    uint8_t frame[8 + TRACE_MAX_ARGS_BYTES + 1];
+    frame[2] = id;
+    frame[3] = length;
+    memcpy(&frame[8], args, length);
+    Trace_send(frame, length);
+}
+
+#endif
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "main.h"
+#include "config.h"
+#include <string.h>
+
+/**
+ * Binary event trace
+ *
+ * Each event goes out on the debug UART as one frame:
+ *
+ *   0xA5 0x5A | id | len | t_us (u32 LE) | args (len bytes, LE) | sum
+ *
+ * where sum makes the 8-bit sum of id..sum zero. Text from DEBUG_MY shares
+ * the port; scripts/trace_decode.py resynchronises on the sync bytes and the
+ * checksum and passes anything else through as text.
+ *
+ * Event names, argument formats and argument names live only in the table
+ * below, which the host decoder parses; none of those strings are compiled
+ * into the firmware. Format characters follow Python struct:
+ *   b/B int8/uint8, h/H int16/uint16, i/I int32/uint32, f float
+ * TRACE() checks its arguments against the format at compile time, so pass
+ * exactly the declared types (cast where needed).
+ *
+ * Keep ids stable: old captures are decoded with the current table.
+ */
+#define TRACE_EVENT_TABLE(X)                                                                              \
+    X(BOOT, 0x01, "I", "reset_flags")                                                                     \
+    X(BUS_RX, 0x10, "BH", "type,length")                                                                  \
+    X(BUS_TX, 0x11, "H", "length")                                                                        \
+    X(BUS_OFFLINE, 0x12, "", "")                                                                          \
+    X(MOTOR_PID, 0x20, "BBfff", "ch,motion,target,input,output")                                          \
+    X(MOTOR_PRESSURE, 0x21, "Bff", "ch,voltage,output")                                                   \
+    X(FILAMENT_MOTION, 0x22, "BB", "ch,motion")                                                           \
+    X(FILAMENT_CHANGE, 0x23, "BBII", "from,to,total_ms,overlap_ms")                                       \
+    X(BUFFER, 0x24, "Bfff", "ch,voltage,extrusion,feed_set")                                              \
+    X(FLASH_JOB, 0x30, "BBI", "key,ok,irq_masked_us")                                                     \
+    X(TELEMETRY, 0x40, "HHHhhHHHhhHHHhhHHHhh",                                                            \
+      "pull_mv0,online_mv0,angle0,speed0,pwm0,pull_mv1,online_mv1,angle1,speed1,pwm1,"                    \
+      "pull_mv2,online_mv2,angle2,speed2,pwm2,pull_mv3,online_mv3,angle3,speed3,pwm3")
+
+enum Trace_event_id : uint8_t
+{
+#define TRACE_EVENT_ENUM(name, id, fmt, args) TRACE_##name = id,
+    TRACE_EVENT_TABLE(TRACE_EVENT_ENUM)
+#undef TRACE_EVENT_ENUM
+};
+
+#define TRACE_SYNC0 0xA5
+#define TRACE_SYNC1 0x5A
+#define TRACE_MAX_ARGS_BYTES 48
+
+#if DEBUG_TRACE_ENABLED
+
+template <typename T> struct Trace_type_code;
+template <> struct Trace_type_code<int8_t> { static constexpr char value = 'b'; };
+template <> struct Trace_type_code<uint8_t> { static constexpr char value = 'B'; };
+template <> struct Trace_type_code<int16_t> { static constexpr char value = 'h'; };
+template <> struct Trace_type_code<uint16_t> { static constexpr char value = 'H'; };
+template <> struct Trace_type_code<int32_t> { static constexpr char value = 'i'; };
+template <> struct Trace_type_code<uint32_t> { static constexpr char value = 'I'; };
+template <> struct Trace_type_code<float> { static constexpr char value = 'f'; };
+
+// Format of an event, only ever evaluated at compile time
+constexpr const char *Trace_event_format(uint8_t id)
+{
+#define TRACE_EVENT_FORMAT(name, _id, fmt, args) \
+    if (id == _id)                               \
+        return fmt;
+    TRACE_EVENT_TABLE(TRACE_EVENT_FORMAT)
+#undef TRACE_EVENT_FORMAT
+    return nullptr;
+}
+
+template <typename... A>
+constexpr bool Trace_format_matches(const char *fmt)
+{
+    if (fmt == nullptr)
+        return false;
+    constexpr char codes[] = {Trace_type_code<A>::value..., 0};
+    for (unsigned i = 0; i < sizeof(codes); i++)
+    {
+        if (fmt[i] != codes[i])
+            return false;
+    }
+    return true;
+}
+
+constexpr int Trace_format_size(const char *fmt)
+{
+    int size = 0;
+    for (; *fmt; fmt++)
+        size += (*fmt == 'b' || *fmt == 'B') ? 1 : (*fmt == 'h' || *fmt == 'H') ? 2 : 4;
+    return size;
+}
+
+extern void Trace_send(uint8_t *frame, int args_length);
+extern void Trace_write(uint8_t id, const void *args, int length);
+
+template <uint8_t ID, typename... A>
+inline void Trace_emit(A... args)
+{
+    static_assert(Trace_format_matches<A...>(Trace_event_format(ID)), "TRACE arguments do not match the event table");
+    constexpr int length = (0 + ... + (int)sizeof(A));
+    static_assert(length <= TRACE_MAX_ARGS_BYTES, "TRACE arguments too long");
+    uint8_t frame[8 + length + 1];
+    frame[2] = ID;
+    frame[3] = length;
+    int offset = 8;
+    ((memcpy(&frame[offset], &args, sizeof(A)), offset += sizeof(A)), ...); // RV32 is little endian like the format
+    Trace_send(frame, length);
+}
+
+/**
+ * Send a packed struct as the arguments of an event, for records too wide
+ * for TRACE(); only the size is checked against the format.
+ */
+template <uint8_t ID, typename T>
+inline void Trace_emit_struct(const T &args)
+{
+    static_assert(Trace_format_size(Trace_event_format(ID)) == sizeof(T), "TRACE_STRUCT size does not match the event table");
+    static_assert(sizeof(T) <= TRACE_MAX_ARGS_BYTES, "TRACE_STRUCT too long");
+    Trace_write(ID, &args, sizeof(T));
+}
+
+#define TRACE(event, ...) Trace_emit<TRACE_##event>(__VA_ARGS__)
+#define TRACE_STRUCT(event, args) Trace_emit_struct<TRACE_##event>(args)
+
+#else
+
+#define TRACE(event, ...) do {} while(0)
+#define TRACE_STRUCT(event, args) do {} while(0)
+
+#endif
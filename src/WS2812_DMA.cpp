@@ -0,0 +1,312 @@
+#include "WS2812_DMA.h"
+
+/*
+ * One WS2812 bit is one TIM1 period (1.25us). Per period:
+ *   update  -> DMA1_Channel5 writes the pin mask to BSHR (line high)
+ *   CC2     -> DMA1_Channel3 writes bit_buf[i] to BCR (low here for a 0 bit, 0 for a 1 bit)
+ *   CC3     -> DMA1_Channel6 writes the pin mask to BCR (low for a 1 bit)
+ * The counter starts at ARR so the first update happens on the first tick.
+ * When the last CC3 transfer completes the timer is reused for the reset
+ * (latch) gap, and its update interrupt starts the next pending strip.
+ *
+ * TIM1 and DMA1 channels 3/5/6 are otherwise unused (ch1 ADC, ch2 debug
+ * TX, ch4 BambuBus TX; TIM2/3/4 drive the motors).
+ */
+#define WS2812_DMA_TICKS_PER_US (SYSTEM_CLOCK_HZ / 1000000)
+#define WS2812_DMA_PERIOD (SYSTEM_CLOCK_HZ / 800000)               // 1.25us per bit
+#define WS2812_DMA_T0H (WS2812_DMA_TICKS_PER_US * 35 / 100)        // 0.35us high for a 0 bit
+#define WS2812_DMA_T1H (WS2812_DMA_TICKS_PER_US * 80 / 100)        // 0.8us high for a 1 bit
+#define WS2812_DMA_RESET (WS2812_DMA_TICKS_PER_US * WS2812_RESET_US) // latch gap
+
+#define WS2812_DMA_MAX_STRIPS 5
+constexpr int WS2812_DMA_max(int a, int b)
+{
+    return a > b ? a : b;
+}
+constexpr int WS2812_DMA_MAX_LEDS =
+    WS2812_DMA_max(WS2812_DMA_max(WS2812_DMA_max(LED_PA11_NUM, LED_PA8_NUM), WS2812_DMA_max(LED_PB1_NUM, LED_PB0_NUM)),
+                   LED_PD1_NUM);
+
+/*
+ * Gamma x brightness tables, generated at compile time. Entries are 8.8
+ * fixed point so the fraction survives for dithering; any non-zero input
+ * gives at least 1.0, so dark filament colors do not turn black at low
+ * brightness.
+ */
+constexpr double WS2812_ln(double x) // x > 0
+{
+    double shift = 0;
+    while (x < 0.5)
+    {
+        x *= 2;
+        shift += 0.69314718055994531;
+    }
+    double y = (x - 1) / (x + 1);
+    double term = y, sum = 0;
+    for (int k = 1; k < 40; k += 2)
+    {
+        sum += term / k;
+        term *= y * y;
+    }
+    return 2 * sum - shift;
+}
+constexpr double WS2812_exp(double x) // x <= 0
+{
+    double sum = 1, term = 1;
+    x /= 16;
+    for (int k = 1; k < 20; k++)
+    {
+        term *= x / k;
+        sum += term;
+    }
+    for (int i = 0; i < 4; i++)
+        sum *= sum; // undo the /16
+    return sum;
+}
+struct WS2812_lut_table
+{
+    uint16_t v[256];
+    constexpr WS2812_lut_table(int brightness) : v()
+    {
+        for (int i = 1; i < 256; i++)
+        {
+            double level = WS2812_exp(LED_GAMMA * WS2812_ln(i / 255.0)) * brightness * 256 + 0.5;
+            v[i] = (level < 256) ? 256 : (uint16_t)level;
+        }
+    }
+};
+constexpr WS2812_lut_table WS2812_luts[WS2812_LUT_COUNT] = {
+    WS2812_lut_table(BRIGHTNESS_CHANNEL),
+    WS2812_lut_table(BRIGHTNESS_MAIN_BOARD),
+};
+
+#if LED_TEMPORAL_DITHER
+// Fraction thresholds for successive frames, so a level of n + k/4 is n + 1 in k of every 4 frames
+const uint8_t WS2812_dither_offsets[4] = {0x20, 0xA0, 0x60, 0xE0};
+#endif
+
+struct WS2812_DMA_strip
+{
+    Adafruit_NeoPixel *strip;
+    GPIO_TypeDef *port;
+    uint32_t pin;
+    const uint16_t *lut;
+    uint8_t frame; // dither phase
+};
+WS2812_DMA_strip WS2812_DMA_strips[WS2812_DMA_MAX_STRIPS];
+int WS2812_DMA_strip_count = 0;
+
+uint16_t WS2812_DMA_bit_buf[WS2812_DMA_MAX_LEDS * 24]; // BCR value at T0H for every bit
+uint32_t WS2812_DMA_pin_mask = 0;                      // source for the constant set/clear transfers
+volatile uint8_t WS2812_DMA_pending = 0;               // strips waiting to be sent, bit per strip
+volatile bool WS2812_DMA_active = false;               // a strip or its latch gap is in progress
+uint8_t WS2812_DMA_next = 0;                           // round-robin start for the next pick
+
+DMA_InitTypeDef WS2812_DMA_InitStructure;
+
+void WS2812_DMA_channel_start(DMA_Channel_TypeDef *channel, volatile uint32_t *reg, const void *src, uint16_t count,
+                              bool increment)
+{
+    DMA_Cmd(channel, DISABLE);
+    WS2812_DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)reg;
+    WS2812_DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)src;
+    WS2812_DMA_InitStructure.DMA_BufferSize = count;
+    WS2812_DMA_InitStructure.DMA_MemoryInc = increment ? DMA_MemoryInc_Enable : DMA_MemoryInc_Disable;
+    WS2812_DMA_InitStructure.DMA_MemoryDataSize = increment ? DMA_MemoryDataSize_HalfWord : DMA_MemoryDataSize_Word;
+    DMA_Init(channel, &WS2812_DMA_InitStructure);
+    DMA_Cmd(channel, ENABLE);
+}
+
+// Encode strip n and start clocking it out. Called with the engine idle.
+void WS2812_DMA_start(int n)
+{
+    WS2812_DMA_strip *s = &WS2812_DMA_strips[n];
+    const uint8_t *pixels = s->strip->getPixels();
+    uint16_t bytes = s->strip->numPixels() * 3;
+    uint16_t bits = 0;
+
+    WS2812_DMA_pending &= ~(1 << n);
+    if (bytes > sizeof(WS2812_DMA_bit_buf) / sizeof(WS2812_DMA_bit_buf[0]) / 8)
+        bytes = sizeof(WS2812_DMA_bit_buf) / sizeof(WS2812_DMA_bit_buf[0]) / 8;
+#if LED_TEMPORAL_DITHER
+    uint8_t dither = WS2812_dither_offsets[s->frame++ & 3];
+#else
+    const uint8_t dither = 0x80; // round to nearest
+#endif
+    for (uint16_t i = 0; i < bytes; i++)
+    {
+        uint16_t level = (s->lut[pixels[i]] + dither) >> 8;
+        uint8_t value = (level > 255) ? 255 : level;
+        for (uint8_t mask = 0x80; mask; mask >>= 1)
+        {
+            WS2812_DMA_bit_buf[bits++] = (value & mask) ? 0 : s->pin;
+        }
+    }
+    if (bits == 0)
+        return;
+
+    WS2812_DMA_active = true;
+    WS2812_DMA_pin_mask = s->pin;
+    WS2812_DMA_channel_start(DMA1_Channel5, &s->port->BSHR, &WS2812_DMA_pin_mask, bits, false);
+    WS2812_DMA_channel_start(DMA1_Channel3, &s->port->BCR, WS2812_DMA_bit_buf, bits, true);
+    WS2812_DMA_channel_start(DMA1_Channel6, &s->port->BCR, &WS2812_DMA_pin_mask, bits, false);
+    DMA_ITConfig(DMA1_Channel6, DMA_IT_TC, ENABLE);
+
+    TIM_SetAutoreload(TIM1, WS2812_DMA_PERIOD - 1);
+    TIM_SetCounter(TIM1, WS2812_DMA_PERIOD - 1);
+    TIM_ClearFlag(TIM1, 0xFFFF);
+    TIM_DMACmd(TIM1, TIM_DMA_Update | TIM_DMA_CC2 | TIM_DMA_CC3, ENABLE);
+    TIM_Cmd(TIM1, ENABLE);
+}
+
+// Start the next pending strip, round-robin, or go idle
+void WS2812_DMA_start_next()
+{
+    for (int i = 0; i < WS2812_DMA_strip_count; i++)
+    {
+        int n = (WS2812_DMA_next + i) % WS2812_DMA_strip_count;
+        if (WS2812_DMA_pending & (1 << n))
+        {
+            WS2812_DMA_next = n + 1;
+            WS2812_DMA_start(n);
+            if (WS2812_DMA_active)
+                return;
+        }
+    }
+    WS2812_DMA_active = false;
+}
+
+/**
+ * Set up TIM1 and the DMA channels. Call after the strips' begin().
+ */
+void WS2812_DMA_init()
+{
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_TIM1, ENABLE);
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+    TIM_TimeBaseStructure.TIM_Period = WS2812_DMA_PERIOD - 1;
+    TIM_TimeBaseStructure.TIM_Prescaler = 0;
+    TIM_TimeBaseStructure.TIM_ClockDivision = 0;
+    TIM_TimeBaseStructure.TIM_CounterMode = TIM_CounterMode_Up;
+    TIM_TimeBaseStructure.TIM_RepetitionCounter = 0;
+    TIM_TimeBaseInit(TIM1, &TIM_TimeBaseStructure);
+    TIM_ARRPreloadConfig(TIM1, DISABLE); // ARR is switched between bit period and latch gap on the fly
+
+    TIM_OCInitTypeDef TIM_OCInitStructure = {0};
+    TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_Timing; // compare events only, no pin output
+    TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Disable;
+    TIM_OCInitStructure.TIM_Pulse = WS2812_DMA_T0H;
+    TIM_OC2Init(TIM1, &TIM_OCInitStructure);
+    TIM_OCInitStructure.TIM_Pulse = WS2812_DMA_T1H;
+    TIM_OC3Init(TIM1, &TIM_OCInitStructure);
+    TIM_OC2PreloadConfig(TIM1, TIM_OCPreload_Disable);
+    TIM_OC3PreloadConfig(TIM1, TIM_OCPreload_Disable);
+
+    WS2812_DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+    WS2812_DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+    WS2812_DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    WS2812_DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+    WS2812_DMA_InitStructure.DMA_Priority = DMA_Priority_High; // below BambuBus TX and ADC
+    WS2812_DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+    DMA_DeInit(DMA1_Channel3);
+    DMA_DeInit(DMA1_Channel5);
+    DMA_DeInit(DMA1_Channel6);
+
+    // Below the BambuBus USART interrupt, so bus bytes always win
+    NVIC_InitTypeDef NVIC_InitStructure = {0};
+    NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel6_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 2;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+    NVIC_InitStructure.NVIC_IRQChannel = TIM1_UP_IRQn;
+    NVIC_Init(&NVIC_InitStructure);
+}
+
+// Look up a strip, registering it on first use
+int WS2812_DMA_find(Adafruit_NeoPixel &strip)
+{
+    int n = 0;
+    while ((n < WS2812_DMA_strip_count) && (WS2812_DMA_strips[n].strip != &strip))
+        n++;
+    if (n == WS2812_DMA_strip_count)
+    {
+        if (n >= WS2812_DMA_MAX_STRIPS)
+            return -1;
+        PinName const pin_name = digitalPinToPinName(strip.getPin());
+        WS2812_DMA_strips[n].strip = &strip;
+        WS2812_DMA_strips[n].port = get_GPIO_Port(CH_PORT(pin_name));
+        WS2812_DMA_strips[n].pin = CH_GPIO_PIN(pin_name);
+        WS2812_DMA_strips[n].lut = WS2812_luts[WS2812_LUT_CHANNEL].v;
+        WS2812_DMA_strips[n].frame = 0;
+        WS2812_DMA_strip_count++;
+    }
+    return n;
+}
+
+/**
+ * Select the gamma x brightness table of a strip
+ */
+void WS2812_DMA_set_lut(Adafruit_NeoPixel &strip, WS2812_lut lut)
+{
+    int n = WS2812_DMA_find(strip);
+    if (n >= 0)
+        WS2812_DMA_strips[n].lut = WS2812_luts[lut].v;
+}
+
+/**
+ * Send a strip's current pixel data. Returns immediately; if another strip
+ * is being sent this one follows it. Showing the same strip again before it
+ * went out only sends the newest data once.
+ */
+void WS2812_DMA_show(Adafruit_NeoPixel &strip)
+{
+    int n = WS2812_DMA_find(strip);
+    if (n < 0)
+        return;
+
+    // Only the engine's own interrupts are held off while deciding who starts the strip
+    NVIC_DisableIRQ(DMA1_Channel6_IRQn);
+    NVIC_DisableIRQ(TIM1_UP_IRQn);
+    WS2812_DMA_pending |= 1 << n;
+    if (!WS2812_DMA_active)
+        WS2812_DMA_start_next();
+    NVIC_EnableIRQ(TIM1_UP_IRQn);
+    NVIC_EnableIRQ(DMA1_Channel6_IRQn);
+}
+
+/**
+ * @return true while a strip or its latch gap is being sent
+ */
+bool WS2812_DMA_busy()
+{
+    return WS2812_DMA_active;
+}
+
+// Last bit's CC3 clear is done: stop the bit transfers and time the latch gap
+extern "C" void DMA1_Channel6_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
+void DMA1_Channel6_IRQHandler(void)
+{
+    DMA_ClearITPendingBit(DMA1_IT_GL6);
+    TIM_DMACmd(TIM1, TIM_DMA_Update | TIM_DMA_CC2 | TIM_DMA_CC3, DISABLE);
+    DMA_Cmd(DMA1_Channel3, DISABLE);
+    DMA_Cmd(DMA1_Channel5, DISABLE);
+    DMA_Cmd(DMA1_Channel6, DISABLE);
+    DMA_ClearITPendingBit(DMA1_IT_GL3 | DMA1_IT_GL5);
+
+    TIM_SetCounter(TIM1, 0);
+    TIM_SetAutoreload(TIM1, WS2812_DMA_RESET - 1);
+    TIM_ClearITPendingBit(TIM1, TIM_IT_Update);
+    TIM_ITConfig(TIM1, TIM_IT_Update, ENABLE);
+}
+
+// Latch gap elapsed: the strip has taken its data
+extern "C" void TIM1_UP_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
+void TIM1_UP_IRQHandler(void)
+{
+    TIM_ClearITPendingBit(TIM1, TIM_IT_Update);
+    TIM_ITConfig(TIM1, TIM_IT_Update, DISABLE);
+    TIM_Cmd(TIM1, DISABLE);
+    WS2812_DMA_start_next();
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "main.h"
+#include "Adafruit_NeoPixel.h"
+
+/**
+ * Interrupt-free WS2812 output
+ *
+ * Replaces Adafruit_NeoPixel::show(), which masks interrupts while it
+ * bit-bangs the strip. TIM1 paces the bits and three DMA channels write the
+ * pin's GPIO set/reset registers, so the CPU is not involved while a strip
+ * is being clocked out and the BambuBus RX interrupt is never masked.
+ *
+ * Strips are sent one at a time; WS2812_DMA_show() only encodes the strip
+ * into the bit buffer or marks it pending if another strip is on the wire.
+ */
+/**
+ * Brightness tables, selected per strip. Pixels stay full scale in the
+ * strip buffer; gamma and brightness are applied while encoding.
+ */
+enum WS2812_lut
+{
+    WS2812_LUT_CHANNEL,    ///< BRIGHTNESS_CHANNEL
+    WS2812_LUT_MAIN_BOARD, ///< BRIGHTNESS_MAIN_BOARD
+    WS2812_LUT_COUNT
+};
+
+extern void WS2812_DMA_init();
+extern void WS2812_DMA_set_lut(Adafruit_NeoPixel &strip, WS2812_lut lut);
+extern void WS2812_DMA_show(Adafruit_NeoPixel &strip);
+extern bool WS2812_DMA_busy();
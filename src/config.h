@@ -18,10 +18,14 @@
 #define LED_PB1_NUM     2    ///< Number of RGB LEDs on channel PB1
 #define LED_PB0_NUM     2    ///< Number of RGB LEDs on channel PB0
 #define LED_PD1_NUM     1    ///< Number of RGB LEDs on main board (PD1)
+#define LED_REFRESH_HZ  50   ///< Maximum LED frame rate; changes within a frame are sent together
+#define WS2812_RESET_US 300  ///< Low time that latches a strip's data (newer WS2812B need >280us)
 
 // RGB LED Brightness (0-255)
 #define BRIGHTNESS_MAIN_BOARD   35   ///< Main board LED brightness
 #define BRIGHTNESS_CHANNEL      15   ///< Channel LED brightness
+#define LED_GAMMA               2.2  ///< Gamma applied with the brightness table when pixels are encoded
+#define LED_TEMPORAL_DITHER     0    ///< 1: dither the fractional part of dim colors across frames (resends every frame)
 
 // System Clock Configuration
 #define SYSTEM_CLOCK_HZ         144000000UL  ///< System clock frequency in Hz
@@ -31,7 +35,35 @@
 // =============================================================================
 
 #define DEBUG_UART_BAUDRATE     115200      ///< Debug UART baud rate
+#define DEBUG_LOG_BUFFER_SIZE   1024        ///< Debug log ring size in bytes (power of 2)
+
+// Log levels, resolved at compile time; messages above a module's level are not compiled in
+#define LOG_LEVEL_NONE          0
+#define LOG_LEVEL_ERROR         1
+#define LOG_LEVEL_WARN          2
+#define LOG_LEVEL_INFO          3
+#define LOG_LEVEL_TRACE         4
+#define DEBUG_LOG_LEVEL         LOG_LEVEL_INFO   ///< Default level for all modules
+#define DEBUG_LOG_BUS           DEBUG_LOG_LEVEL  ///< BambuBus protocol
+#define DEBUG_LOG_MOTION        DEBUG_LOG_LEVEL  ///< Motor control and direction learning (TRACE: per-sample detail)
+#define DEBUG_LOG_SENSOR        DEBUG_LOG_LEVEL  ///< ADC and AS5600 readings
+#define DEBUG_LOG_FLASH         DEBUG_LOG_LEVEL  ///< Flash key/value storage
+#define DEBUG_LOG_LED           DEBUG_LOG_LEVEL  ///< RGB LEDs
+#define DEBUG_TRACE_ENABLED     0           ///< 1: emit binary trace frames (see Trace.h, decode with scripts/trace_decode.py)
+#define DEBUG_TRACE_BAUDRATE    1000000     ///< Debug UART baud rate used when tracing is enabled
+#define TELEMETRY_RATE_HZ       0           ///< Sensor telemetry frames per second at boot (0 = off, needs DEBUG_TRACE_ENABLED)
+#define TELEMETRY_MAX_RATE_HZ   1000        ///< Upper limit for the telemetry rate (~50 kB/s at 1000 Hz)
+#define DEBUG_CONSOLE_ENABLED   1           ///< 1: accept commands on the debug UART RX (see Console.h)
+#define DEBUG_CONSOLE_LINE_MAX  64          ///< Longest command line accepted
+#define BOOT_FIRST_REPLY_BUDGET_MS 100       ///< Warn when the first BambuBus reply comes later than this after reset
+#define BOOT_REPORT_TIMEOUT_MS  5000        ///< Print the boot timeline by then even if a phase never completed
+#ifndef PROFILE_ENABLED                     // the native env turns it on for test_profile
+#define PROFILE_ENABLED         0           ///< 1: time main-loop regions (Profile.h), dump with the "profile" console command
+#endif
 #define BAMBU_BUS_VERSION       5           ///< BambuBus protocol version
+#define BAMBU_BUS_SAVE_SCHEMA   0x10        ///< Schema version of persisted filament data (TLV, see BambuBus.cpp)
+#define BAMBU_BUS_SAVE_DEBOUNCE_MS  500     ///< Quiet time after the last change before filament data is saved
+#define BAMBU_BUS_SAVE_MAX_DELAY_MS 5000    ///< Upper bound on how long a burst of changes can defer the save
 
 // =============================================================================
 // Firmware Version Configuration
@@ -65,14 +97,74 @@
 #define PULL_VOLTAGE_HIGH       1.85f       ///< High pressure threshold (red LED)
 #define PULL_VOLTAGE_LOW        1.45f       ///< Low pressure threshold (blue LED)
 #define PULL_VOLTAGE_SEND_MAX   1.7f        ///< Maximum voltage for sending filament
+#define PULL_VOLTAGE_TARGET_LOW  1.65f      ///< In use: feed while the buffer is below this voltage
+#define PULL_VOLTAGE_TARGET_HIGH 1.7f       ///< In use: pull back while the buffer is above this voltage
+
+// Control loop gains (I and D are already multiplied by P); runtime values can be changed from the console
+#define MOTOR_SPEED_PID_P       2.0f        ///< Speed loop proportional gain
+#define MOTOR_SPEED_PID_I       20.0f       ///< Speed loop integral gain
+#define MOTOR_SPEED_PID_D       0.0f        ///< Speed loop derivative gain
+#define MOTOR_PRESSURE_PID_P    1500.0f     ///< Buffer pressure loop proportional gain
+#define MOTOR_PRESSURE_PID_I    0.0f        ///< Buffer pressure loop integral gain
+#define MOTOR_PRESSURE_PID_D    0.0f        ///< Buffer pressure loop derivative gain
 
 // Timing constants (in milliseconds)
 #define ASSIST_SEND_TIME_MS     1200        ///< Filament send assist duration
 #define RGB_UPDATE_INTERVAL_MS  3000        ///< RGB update interval for error states
+#define SENSOR_PERIOD_MS        1           ///< Buffer/presence ADC sampling period
+#define CONTROL_PERIOD_MS       2           ///< AS5600 read and motor control period, independent of bus traffic
+#define SENSOR_IDLE_PERIOD_MS   20          ///< Sampling period once every channel has been idle for MOTION_IDLE_ENTER_MS
+#define CONTROL_IDLE_PERIOD_MS  20          ///< Control period once every channel has been idle for MOTION_IDLE_ENTER_MS
+#define MOTION_IDLE_ENTER_MS    2000        ///< No motor output or filament movement for this long slows the two tasks above
+#define SCHED_IDLE_WFI          1           ///< Sleep in WFI when no task is ready (0 to busy-wait)
+
+// Feed and retract motion profile
+#define FEED_SPEED_MM_S         50.0f       ///< AMS feed cruise speed
+#define RETRACT_SPEED_MM_S      50.0f       ///< Retract cruise speed
+#define MOTION_ACCEL_MM_S2      400.0f      ///< Speed set-point acceleration limit
+#define MOTION_JERK_MM_S3       4000.0f     ///< Acceleration ramp rate for S-curves (0 = trapezoidal)
+#define MOTION_CREEP_SPEED_MM_S 3.0f        ///< Speed at which distance-limited moves arrive at their target
+
+// AMS lite in-use buffer control: feed at the estimated extrusion rate
+#define BUFFER_MM_PER_V         20.0f       ///< Filament taken up by the buffer per volt of slider travel (console: buffer_mm_per_v)
+#define BUFFER_VOLTAGE_FILTER_S 0.02f       ///< Low-pass time constant of the buffer voltage
+#define BUFFER_RATE_FILTER_S    0.1f        ///< Low-pass time constant of the extrusion rate estimate
+#define BUFFER_CENTER_TIME_S    0.2f        ///< Time constant for pulling the buffer back to the target
+#define BUFFER_TARGET_SLEW_V_S  0.2f        ///< After loading, the target moves from the entry voltage to the centre this fast
+#define BUFFER_MAX_FEED_MM_S    40.0f       ///< Feed speed limit
+#define BUFFER_MAX_RETRACT_MM_S 5.0f        ///< Pull-back speed limit when the buffer is overfull
+#define BUFFER_MIN_SPEED_MM_S   1.0f        ///< Smaller set-points stop the motor
+
+// Motor model: feed-forward and deadband compensation identified online from speed/PWM pairs
+#define MOTOR_MODEL_ENABLED     1           ///< Use the identified model once a channel has one (0: PID + fixed pwm_zero only)
+#define MOTOR_MODEL_FORGET      0.999f      ///< Per-sample forgetting factor of the fit (~1000-sample memory)
+#define MOTOR_MODEL_MIN_SAMPLES 200         ///< Samples before a fit is trusted
+#define MOTOR_MODEL_MIN_SPEED_MM_S 5.0f     ///< Slower samples are too noisy to fit
+#define MOTOR_MODEL_MIN_SPREAD_MM_S 5.0f    ///< Minimum speed standard deviation in the fit
+#define MOTOR_MODEL_STOPPED_MM_S 0.5f       ///< Below this the motor counts as stopped
+#define MOTOR_MODEL_SAVE_INTERVAL_MS 600000 ///< Minimum time between flash saves of the model
+
+// PID relay auto-tune (console "autotune", or once after direction learning)
+#define AUTOTUNE_AFTER_LEARNING 1           ///< Tune the speed loop of a channel once its direction is learned
+#define AUTOTUNE_SPEED_MM_S     20.0f       ///< Speed the relay oscillates around
+#define AUTOTUNE_SPEED_RELAY_PWM 150.0f     ///< Relay amplitude around the bias, speed test
+#define AUTOTUNE_SPEED_HYSTERESIS_MM_S 1.0f ///< Relay switching hysteresis, speed test
+#define AUTOTUNE_PRESSURE_RELAY_PWM 300.0f  ///< Relay amplitude, pressure test
+#define AUTOTUNE_PRESSURE_HYSTERESIS_V 0.02f ///< Relay switching hysteresis, pressure test
+#define AUTOTUNE_PRESSURE_TOLERANCE_V 0.05f ///< Mean error allowed while validating pressure gains
+#define AUTOTUNE_MAX_TRAVEL_MM  30.0f       ///< Filament the speed test may move before turning back
+#define AUTOTUNE_CYCLES         4           ///< Limit cycles averaged for Ku and Tu
+#define AUTOTUNE_SWITCH_TIMEOUT_MS 200      ///< Shift the relay bias when it has not switched for this long
+#define AUTOTUNE_TIMEOUT_MS     10000       ///< Give up a relay phase after this long
+#define AUTOTUNE_VALIDATE_MS    1000        ///< Closed-loop check of the new gains, per step
+#define AUTOTUNE_MAX_OVERSHOOT  0.3f        ///< Overshoot allowed while validating, fraction of the set-point
+#define AUTOTUNE_MAX_ERROR      0.15f       ///< Mean error allowed over the second half of a step, fraction
 
 // Filament distances (in millimeters)
 #define P1X_OUT_FILAMENT_MM     200.0f      ///< Internal filament retraction distance
 #define P1X_OUT_FILAMENT_EXT_MM 700.0f      ///< External filament retraction distance
+#define CHANGE_OVERLAP_START_MM 100.0f      ///< Outgoing filament must have retracted this far before the next channel feeds
+#define CHANGE_PREFEED_MM       50.0f       ///< Next channel may feed this far while the outgoing one is still retracting
 
 // Speed filtering constant
 #define SPEED_FILTER_K          100         ///< Speed calculation filter coefficient
@@ -84,6 +176,17 @@
 #define FLASH_SAVE_ADDRESS      0x0800F000UL ///< Flash memory address for persistent data
 #define FLASH_MAGIC_NUMBER      0x40614061UL ///< Magic number for flash data validation
 
+// Append-only key/value log occupying the last two flash pages. It replaces the
+// fixed save slots at 0x0800E000 (motor directions) and FLASH_SAVE_ADDRESS
+// (filament data); those legacy images are still read once for migration.
+#define FLASH_KV_BASE_ADDRESS   0x0800E000UL ///< First page of the key/value log
+#define FLASH_KV_PAGE_COUNT     2            ///< Pages used by the log (active + compaction target)
+#define FLASH_KV_MAX_KEYS       32           ///< Keys are 0..FLASH_KV_MAX_KEYS-1
+#define FLASH_KV_MAX_VALUE      64           ///< Largest value accepted by Flash_kv_write (bytes)
+#define FLASH_KV_QUEUE_SIZE     11           ///< Queued writes: one per key in use plus the one being programmed
+#define FLASH_KV_STEP_HALFWORDS 8            ///< Half-words programmed per Flash_kv_run() step
+#define FLASH_VERIFY_WRITES     1            ///< Read back every programmed half-word (0 to skip)
+
 // =============================================================================
 // Sensor Configuration
 // =============================================================================
@@ -144,7 +247,6 @@
 #define AUTO_DIRECTION_CONFIDENCE_THRESHOLD 0.7f    ///< Minimum confidence ratio required (0.6-0.9 recommended)
 #define AUTO_DIRECTION_MAX_NOISE_MM        0.5f     ///< Maximum acceptable sensor noise per sample in mm
 #define AUTO_DIRECTION_SAMPLE_INTERVAL_MS  100      ///< Minimum time between samples in ms
-#define AUTO_DIRECTION_DEBUG_ENABLED       false    ///< Enable debug output for direction learning
 
 /**
  * Legacy Motor Direction Correction (Fallback)
@@ -23,15 +23,16 @@ Adafruit_NeoPixel strip_PD1(LED_PD1_NUM, PD1, NEO_GRB + NEO_KHZ800);
 
 /**
  * Set RGB brightness for all LED strips
- * Values range from 0-255, configured in config.h
+ * Pixel buffers stay full scale; the gamma x brightness table selected here
+ * (built from the config.h values) is applied when the strip is sent.
  */
 void RGB_Set_Brightness() {
     // Main board brightness
-    strip_PD1.setBrightness(BRIGHTNESS_MAIN_BOARD);
+    WS2812_DMA_set_lut(strip_PD1, WS2812_LUT_MAIN_BOARD);
     
     // Set brightness for all channels
     for (int i = 0; i < MAX_FILAMENT_CHANNELS; i++) {
-        strip_channel[i].setBrightness(BRIGHTNESS_CHANNEL);
+        WS2812_DMA_set_lut(strip_channel[i], WS2812_LUT_CHANNEL);
     }
 }
 
@@ -43,18 +44,52 @@ void RGB_init() {
     for (int i = 0; i < MAX_FILAMENT_CHANNELS; i++) {
         strip_channel[i].begin();
     }
+    WS2812_DMA_init();
 }
 
 /**
  * Update all RGB LED strips with current data
  */
 void RGB_show_data() {
-    strip_PD1.show();
+    WS2812_DMA_show(strip_PD1);
     for (int i = 0; i < MAX_FILAMENT_CHANNELS; i++) {
-        strip_channel[i].show();
+        WS2812_DMA_show(strip_channel[i]);
     }
 }
 
+/*
+ * LED frame compositor
+ * Pixel changes only update the strips' pixel buffers (the shadow frame) and
+ * set the strip's dirty bit. RGB_flush() sends each dirty strip once, at most
+ * LED_REFRESH_HZ times per second, so a loop that changes many LEDs still
+ * costs one transfer per strip.
+ */
+#define RGB_STRIP_SYS MAX_FILAMENT_CHANNELS // dirty bit of the main board strip
+uint8_t RGB_dirty = 0;                      // bit n: strip_channel[n] changed, RGB_STRIP_SYS: strip_PD1
+
+void RGB_flush()
+{
+    static uint64_t last_flush_time = 0;
+    if (RGB_dirty == 0)
+        return;
+    uint64_t now = get_time64();
+    if (now - last_flush_time < 1000 / LED_REFRESH_HZ)
+        return;
+    last_flush_time = now;
+
+    for (int i = 0; i < MAX_FILAMENT_CHANNELS; i++) {
+        if (RGB_dirty & (1 << i))
+            WS2812_DMA_show(strip_channel[i]);
+    }
+    if (RGB_dirty & (1 << RGB_STRIP_SYS))
+        WS2812_DMA_show(strip_PD1);
+#if LED_TEMPORAL_DITHER
+    RGB_dirty = (1 << (RGB_STRIP_SYS + 1)) - 1; // dithering needs a fresh frame every time
+#else
+    RGB_dirty = 0;
+#endif
+}
+
 // Global variables for channel color storage
 uint8_t channel_colors[MAX_FILAMENT_CHANNELS][4] = {
     {DEFAULT_COLOR_R, DEFAULT_COLOR_G, DEFAULT_COLOR_B, DEFAULT_COLOR_A},
@@ -77,21 +112,28 @@ extern void send_uart(const unsigned char *data, uint16_t length);
 
 void setup()
 {
+    Boot_mark(BOOT_SETUP_ENTRY);
     WWDG_DeInit();
     RCC_APB1PeriphClockCmd(RCC_APB1Periph_WWDG, DISABLE); // Disable watchdog
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_AFIO, ENABLE);
     GPIO_PinRemapConfig(GPIO_Remap_PD01, ENABLE);
     // Initialize RGB lights
     RGB_init();
+    // Set RGB brightness - selects the gamma/brightness table each strip is encoded with
+    RGB_Set_Brightness();
     // Update RGB display
     RGB_show_data();
-    // Set RGB brightness - this maintains color proportions while limiting maximum values
-    RGB_Set_Brightness();
+    Boot_mark(BOOT_RGB_INIT);
 
+    Flash_kv_init();
+    Boot_mark(BOOT_FLASH_KV_INIT);
     BambuBus_init();
+    Boot_mark(BOOT_BUS_INIT);
     DEBUG_init();
-    Motion_control_init();
-    delay(1);
+    Boot_mark(BOOT_DEBUG_INIT);
+    TRACE(BOOT, (uint32_t)RCC->RSTSCKR);
+    Motion_control_init(); // 方向探测和ADC滤波在主循环中后台完成
+    Boot_mark(BOOT_SETUP_DONE);
 }
 
 /**
@@ -107,12 +149,12 @@ void Set_MC_RGB(uint8_t channel, int num, uint8_t R, uint8_t G, uint8_t B)
 {
     // Input validation - bounds checking
     if (channel >= MAX_FILAMENT_CHANNELS) {
-        DEBUG_MY("ERROR: Invalid channel in Set_MC_RGB\n");
+        LOG_MY(LED, ERROR, "ERROR: Invalid channel in Set_MC_RGB\n");
         return;
     }
     
     if (num < 0 || num >= 2) { // Each channel has max 2 LEDs (status and pull-online)
-        DEBUG_MY("ERROR: Invalid LED num in Set_MC_RGB\n");
+        LOG_MY(LED, ERROR, "ERROR: Invalid LED num in Set_MC_RGB\n");
         return;
     }
     
@@ -130,7 +172,7 @@ void Set_MC_RGB(uint8_t channel, int num, uint8_t R, uint8_t G, uint8_t B)
     // Update LED only if color has changed (reduces unnecessary updates)
     if (is_new_colors) {
         strip_channel[channel].setPixelColor(num, strip_channel[channel].Color(R, G, B));
-        strip_channel[channel].show(); // Display new color
+        RGB_dirty |= 1 << channel; // Sent by the next RGB_flush()
     }
 }
 
@@ -142,91 +184,147 @@ void Show_SYS_RGB(int BambuBUS_status)
     if (BambuBUS_status == -1) // Offline
     {
         strip_PD1.setPixelColor(0, strip_PD1.Color(8, 0, 0)); // Red
-        strip_PD1.show();
+        RGB_dirty |= 1 << RGB_STRIP_SYS;
     }
     else if (BambuBUS_status == 0) // Online
     {
         strip_PD1.setPixelColor(0, strip_PD1.Color(8, 9, 9)); // White
-        strip_PD1.show();
+        RGB_dirty |= 1 << RGB_STRIP_SYS;
     }
     // Update error channels, light up red LEDs
     for (int i = 0; i < 4; i++)
     {
         if (MC_STU_ERROR[i])
         {
-            // Red color
-            strip_channel[i].setPixelColor(0, strip_channel[i].Color(255, 0, 0));
-            strip_channel[i].show(); // Display new color
+            // Blinking red on the error layer, above any progress or idle color
+            LED_anim_post(i, 0, LED_LAYER_ERROR, LED_PATTERN_BLINK, LED_rgb(255, 0, 0), LED_rgb(0, 0, 0));
         }
     }
 }
 
+/*
+ * Scheduler tasks, see SCHED_TASK_TABLE in Scheduler.h
+ */
 BambuBus_package_type is_first_run = BambuBus_package_type::NONE;
-void loop()
+int BambuBus_error = -1; // -1 offline, 0 online; latest non-NONE result of BambuBus_run()
+void Sched_task_BUS()
 {
-    while (1)
+    BambuBus_package_type stu;
+    {
+        PROFILE_SCOPE(BUS_RUN);
+        stu = BambuBus_run();
+    }
+    uint16_t device_type = get_now_BambuBus_device_type();
+    if (stu != BambuBus_package_type::NONE) // have data/offline
     {
-        BambuBus_package_type stu = BambuBus_run();
-        // int stu =-1;
-        static int error = 0;
-        bool motion_can_run = false;
-        uint16_t device_type = get_now_BambuBus_device_type();
-        if (stu != BambuBus_package_type::NONE) // have data/offline
+        if (stu == BambuBus_package_type::ERROR) // offline
+            BambuBus_error = -1;
+        else // have data
+            BambuBus_error = 0;
+    }
+    // Log output
+    if (is_first_run != stu)
+    {
+        is_first_run = stu;
+        if (stu == BambuBus_package_type::ERROR)
+        {                                   // offline
+            LOG_MY(BUS, INFO, "BambuBus_offline\n"); // Offline
+        }
+        else if (stu == BambuBus_package_type::heartbeat)
+        {
+            LOG_MY(BUS, INFO, "BambuBus_online\n"); // Online
+        }
+        else if (device_type == BambuBus_AMS_lite)
+        {
+            LOG_MY(BUS, INFO, "Run_To_AMS_lite\n"); // Online as AMS Lite
+        }
+        else if (device_type == BambuBus_AMS)
         {
-            motion_can_run = true;
-            if (stu == BambuBus_package_type::ERROR) // offline
-            {
-                error = -1;
-                // Offline - red light
-            }
-            else // have data
-            {
-                error = 0;
-                // if (stu == BambuBus_package_type::heartbeat)
-                // {
-                // Normal operation - white light
-            }
-            
-            // Update RGB every 3 seconds (defined in config.h)
-            static unsigned long last_sys_rgb_time = 0;
-            unsigned long now = get_time64();
-            if (now - last_sys_rgb_time >= RGB_UPDATE_INTERVAL_MS) {
-                Show_SYS_RGB(error);
-                last_sys_rgb_time = now;
-            }
+            LOG_MY(BUS, INFO, "Run_To_AMS\n"); // Online as AMS
         }
         else
         {
-        } // wait for data
-        // Log output
-        if (is_first_run != stu)
-        {
-            is_first_run = stu;
-            if (stu == BambuBus_package_type::ERROR)
-            {                                   // offline
-                DEBUG_MY("BambuBus_offline\n"); // Offline
-            }
-            else if (stu == BambuBus_package_type::heartbeat)
-            {
-                DEBUG_MY("BambuBus_online\n"); // Online
-            }
-            else if (device_type == BambuBus_AMS_lite)
-            {
-                DEBUG_MY("Run_To_AMS_lite\n"); // Online as AMS Lite
-            }
-            else if (device_type == BambuBus_AMS)
-            {
-                DEBUG_MY("Run_To_AMS\n"); // Online as AMS
-            }
-            else
-            {
-                DEBUG_MY("Running Unknown ???\n");
-            }
+            LOG_MY(BUS, WARN, "Running Unknown ???\n");
         }
+    }
+}
+
+void Sched_task_SENSOR()
+{
+    Motion_control_sample();
+}
+
+void Sched_task_CONTROL()
+{
+    Motion_control_run(BambuBus_error);
+    // 所有通道空闲一段时间后降低采样和控制频率，一有动作立即恢复
+    static uint64_t last_active_time = 0;
+    uint64_t now = get_time64();
+    if (!Motion_control_idle())
+        last_active_time = now;
+    bool slow = (now - last_active_time) >= MOTION_IDLE_ENTER_MS;
+    Sched_set_period(SCHED_SENSOR, slow ? SENSOR_IDLE_PERIOD_MS : SENSOR_PERIOD_MS);
+    Sched_set_period(SCHED_CONTROL, slow ? CONTROL_IDLE_PERIOD_MS : CONTROL_PERIOD_MS);
+}
+
+void Sched_task_CALIBRATION()
+{
+    Motion_control_calibration_run(); // 启动时的后台校准
+    if (!Motion_control_calibrating())
+        Sched_set_period(SCHED_CALIBRATION, 0);
+}
+
+void Sched_task_CONSOLE()
+{
+    PROFILE_SCOPE(CONSOLE);
+    Console_run();
+}
+
+void Sched_task_TELEMETRY()
+{
+    PROFILE_SCOPE(TELEMETRY);
+    Telemetry_run();
+}
+
+void Sched_task_LED()
+{
+    // Refresh the system LED every RGB_UPDATE_INTERVAL_MS (defined in config.h)
+    static unsigned long last_sys_rgb_time = 0;
+    unsigned long now = get_time64();
+    if (now - last_sys_rgb_time >= RGB_UPDATE_INTERVAL_MS)
+    {
+        Show_SYS_RGB(BambuBus_error);
+        last_sys_rgb_time = now;
+    }
+    {
+        PROFILE_SCOPE(LED_ANIM);
+        LED_anim_run();
+    }
+    PROFILE_SCOPE(LED_FLUSH);
+    RGB_flush(); // 每帧每条灯带最多发送一次
+}
+
+void Sched_task_FLASH()
+{
+    PROFILE_SCOPE(FLASH_RUN);
+    Flash_kv_run(BambuBus_is_idle()); // 总线空闲时才推进后台写入
+}
 
-        if (motion_can_run)
+void Sched_task_HOUSEKEEPING()
+{
+    Boot_run();
+}
+
+void loop()
+{
+    while (1)
+    {
+        bool ran;
         {
-            Motion_control_run(error);
+            PROFILE_SCOPE(LOOP);
+            ran = Sched_run();
         }
+        if (!ran)
+            Sched_idle();
     }
 }
@@ -3,12 +3,21 @@
 #include <Arduino.h>
 #include "stdlib.h"
 #include "Debug_log.h"
+#include "Trace.h"
 #include "Flash_saves.h"
+#include "Flash_kv.h"
 #include "Motion_control.h"
 #include "BambuBus.h"
 #include "time64.h"
 #include "many_soft_AS5600.h"
 #include "ADC_DMA.h"
+#include "WS2812_DMA.h"
+#include "LED_anim.h"
+#include "Telemetry.h"
+#include "Console.h"
+#include "Profile.h"
+#include "Boot.h"
+#include "Scheduler.h"
 #include "config.h"
 
 /**
@@ -59,14 +68,14 @@
 extern void Set_MC_RGB(uint8_t channel, int num, uint8_t R, uint8_t G, uint8_t B);
 
 /**
- * Set RGB color for channel status LED (convenience macro)
+ * Post the idle-layer color of a channel's status LED (convenience macro)
  */
-#define MC_STU_RGB_set(channel, R, G, B) Set_MC_RGB(channel, 0, R, G, B)
+#define MC_STU_RGB_set(channel, R, G, B) LED_anim_post(channel, 0, LED_LAYER_IDLE, LED_PATTERN_SOLID, LED_rgb(R, G, B))
 
 /**
- * Set RGB color for channel pull-online LED (convenience macro)  
+ * Post the idle-layer color of a channel's pull-online LED (convenience macro)
  */
-#define MC_PULL_ONLINE_RGB_set(channel, R, G, B) Set_MC_RGB(channel, 1, R, G, B)
+#define MC_PULL_ONLINE_RGB_set(channel, R, G, B) LED_anim_post(channel, 1, LED_LAYER_IDLE, LED_PATTERN_SOLID, LED_rgb(R, G, B))
 
 /**
  * Global variables
@@ -0,0 +1,31 @@
+#pragma once
+
+/*
+ * Host stand-in for the CH32 Arduino core. micros()/millis() are the
+ * simulated clock from src/Host.cpp; delay() and delayMicroseconds() advance
+ * it, so every blocking wait in the firmware shows up in the boot timeline.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <stdlib.h>
+#include "ch32v20x.h"
+typedef uint32_t u32; typedef uint16_t u16; typedef uint8_t u8;
+uint32_t millis(); uint32_t micros(); void delay(uint32_t); void delayMicroseconds(uint32_t);
+void noInterrupts(); void interrupts();
+void pinMode(uint32_t,uint32_t); void digitalWrite(uint32_t,uint32_t);
+enum { PA0,PA1,PA8=8,PA11=11,PB0=16,PB1,PB12=28,PB13,PB14,PB15,PC13=45,PC14,PC15,PD0=48,PD1 };
+#define INPUT 0
+#define OUTPUT 1
+#define OUTPUT_OD 2
+#define INPUT_PULLUP 3
+#define HIGH 1
+#define LOW 0
+template<class T> T max(T a, T b){return a>b?a:b;}
+template<class T> T min(T a, T b){return a<b?a:b;}
+typedef float float_t;
+int digitalPinToPinName(uint32_t); int CH_PORT(int); uint16_t CH_GPIO_PIN(int); GPIO_TypeDef* get_GPIO_Port(int);
+#define pgm_read_byte(x) (*(const uint8_t*)(x))
+#define PROGMEM
+typedef int PinName;
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "Sim_crc.h"
+
+typedef Sim_crc<uint16_t> CRC16;
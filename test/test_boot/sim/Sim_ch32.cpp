@@ -0,0 +1,238 @@
+/*
+ * Simulated CH32V203 for the boot test: RAM peripherals, no-op SPL calls and
+ * the Arduino timing functions on the simulated clock (src/Host.cpp).
+ *
+ * Only waits the firmware asks for take time here: delay(),
+ * delayMicroseconds(), a WFI (until the next 1 ms tick) and the bytes of a
+ * received frame. Code runs in zero time, so the boot test measures the
+ * blocking waits on the path to the first reply, which is where startup
+ * regressions come from.
+ */
+#include <Arduino.h>
+#include "Host.h"
+#include "Sim_ch32.h"
+
+uint32_t SystemCoreClock = 144000000;
+
+static GPIO_TypeDef Sim_GPIO[4];
+static USART_TypeDef Sim_USART[2];
+static DMA_Channel_TypeDef Sim_DMA_channel[7];
+static DMA_TypeDef Sim_DMA;
+static TIM_TypeDef Sim_TIM[4];
+static SysTick_Type Sim_SysTick;
+static ADC_TypeDef Sim_ADC;
+static RCC_TypeDef Sim_RCC;
+
+GPIO_TypeDef *GPIOA = &Sim_GPIO[0], *GPIOB = &Sim_GPIO[1], *GPIOC = &Sim_GPIO[2], *GPIOD = &Sim_GPIO[3];
+USART_TypeDef *USART1 = &Sim_USART[0], *USART3 = &Sim_USART[1];
+DMA_Channel_TypeDef *DMA1_Channel1 = &Sim_DMA_channel[0], *DMA1_Channel2 = &Sim_DMA_channel[1],
+                    *DMA1_Channel3 = &Sim_DMA_channel[2], *DMA1_Channel4 = &Sim_DMA_channel[3],
+                    *DMA1_Channel5 = &Sim_DMA_channel[4], *DMA1_Channel6 = &Sim_DMA_channel[5],
+                    *DMA1_Channel7 = &Sim_DMA_channel[6];
+DMA_TypeDef *DMA1 = &Sim_DMA;
+TIM_TypeDef *TIM1 = &Sim_TIM[0], *TIM2 = &Sim_TIM[1], *TIM3 = &Sim_TIM[2], *TIM4 = &Sim_TIM[3];
+SysTick_Type *SysTick = &Sim_SysTick;
+ADC_TypeDef *ADC1 = &Sim_ADC;
+RCC_TypeDef *RCC = &Sim_RCC;
+
+/*
+ * Arduino core
+ */
+void delay(uint32_t ms)
+{
+    Host_set_time_us(micros() + ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    Host_set_time_us(micros() + us);
+}
+
+void noInterrupts() {}
+void interrupts() {}
+void pinMode(uint32_t, uint32_t) {}
+void digitalWrite(uint32_t, uint32_t) {}
+
+// Pins are numbered port * 16 + pin, like the core's PinName
+int digitalPinToPinName(uint32_t pin)
+{
+    return pin;
+}
+
+int CH_PORT(int pin_name)
+{
+    return pin_name / 16;
+}
+
+uint16_t CH_GPIO_PIN(int pin_name)
+{
+    return 1 << (pin_name % 16);
+}
+
+GPIO_TypeDef *get_GPIO_Port(int port)
+{
+    return &Sim_GPIO[port & 3];
+}
+
+// Woken by the next SysTick
+void __WFI()
+{
+    Host_set_time_us((micros() / 1000 + 1) * 1000);
+}
+
+void __disable_irq() {}
+void __enable_irq() {}
+
+/*
+ * BambuBus: USART1 RX by interrupt, TX by DMA1 channel 4
+ */
+extern "C" void USART1_IRQHandler(void);
+
+#define SIM_BUS_BYTE_US 9 // 11 bits at 1.25 Mbaud, rounded up
+
+static int Sim_usart1_rx = -1;
+static uint32_t Sim_tx_count = 0;
+static uint32_t Sim_tx_length = 0;
+
+void Sim_bus_receive(const uint8_t *data, int length)
+{
+    for (int i = 0; i < length; i++)
+    {
+        Host_set_time_us(micros() + SIM_BUS_BYTE_US);
+        Sim_usart1_rx = data[i];
+        USART1_IRQHandler();
+    }
+}
+
+uint32_t Sim_bus_tx_count()
+{
+    return Sim_tx_count;
+}
+
+uint32_t Sim_bus_tx_length()
+{
+    return Sim_tx_length;
+}
+
+void USART_Init(USART_TypeDef *, USART_InitTypeDef *) {}
+void USART_ITConfig(USART_TypeDef *, uint16_t, FunctionalState) {}
+void USART_Cmd(USART_TypeDef *, FunctionalState) {}
+void USART_ClearITPendingBit(USART_TypeDef *, uint16_t) {}
+void USART_DMACmd(USART_TypeDef *, uint16_t, FunctionalState) {}
+
+ITStatus USART_GetITStatus(USART_TypeDef *usart, uint16_t it)
+{
+    return ((usart == USART1) && (it == USART_IT_RXNE) && (Sim_usart1_rx >= 0)) ? SET : RESET;
+}
+
+FlagStatus USART_GetFlagStatus(USART_TypeDef *, uint16_t)
+{
+    return RESET;
+}
+
+uint16_t USART_ReceiveData(USART_TypeDef *)
+{
+    uint16_t data = (uint16_t)Sim_usart1_rx;
+    Sim_usart1_rx = -1;
+    return data;
+}
+
+void DMA_Init(DMA_Channel_TypeDef *channel, DMA_InitTypeDef *init)
+{
+    channel->CNTR = init->DMA_BufferSize;
+    if (channel == DMA1_Channel4)
+    {
+        Sim_tx_count++;
+        Sim_tx_length = init->DMA_BufferSize;
+    }
+}
+
+/*
+ * Everything else only configures hardware; ADC calibration completes at once
+ */
+void GPIO_Init(GPIO_TypeDef *, GPIO_InitTypeDef *) {}
+void GPIO_PinRemapConfig(uint32_t, FunctionalState) {}
+void NVIC_Init(NVIC_InitTypeDef *) {}
+void NVIC_EnableIRQ(int) {}
+void NVIC_DisableIRQ(int) {}
+void DMA_DeInit(DMA_Channel_TypeDef *) {}
+void DMA_Cmd(DMA_Channel_TypeDef *, FunctionalState) {}
+void DMA_ITConfig(DMA_Channel_TypeDef *, uint32_t, FunctionalState) {}
+ITStatus DMA_GetITStatus(uint32_t)
+{
+    return RESET;
+}
+void DMA_ClearITPendingBit(uint32_t) {}
+void DMA_ClearFlag(uint32_t) {}
+uint16_t DMA_GetCurrDataCounter(DMA_Channel_TypeDef *channel)
+{
+    return channel->CNTR;
+}
+void TIM_TimeBaseInit(TIM_TypeDef *, TIM_TimeBaseInitTypeDef *) {}
+void TIM_OC1Init(TIM_TypeDef *, TIM_OCInitTypeDef *) {}
+void TIM_OC2Init(TIM_TypeDef *, TIM_OCInitTypeDef *) {}
+void TIM_OC3Init(TIM_TypeDef *, TIM_OCInitTypeDef *) {}
+void TIM_OC4Init(TIM_TypeDef *, TIM_OCInitTypeDef *) {}
+void TIM_CtrlPWMOutputs(TIM_TypeDef *, FunctionalState) {}
+void TIM_ARRPreloadConfig(TIM_TypeDef *, FunctionalState) {}
+void TIM_Cmd(TIM_TypeDef *, FunctionalState) {}
+void TIM_SetCompare1(TIM_TypeDef *tim, uint16_t value)
+{
+    tim->CH1CVR = value;
+}
+void TIM_SetCompare2(TIM_TypeDef *tim, uint16_t value)
+{
+    tim->CH2CVR = value;
+}
+void TIM_SetCompare3(TIM_TypeDef *tim, uint16_t value)
+{
+    tim->CH3CVR = value;
+}
+void TIM_SetCompare4(TIM_TypeDef *tim, uint16_t value)
+{
+    tim->CH4CVR = value;
+}
+void TIM_DMACmd(TIM_TypeDef *, uint16_t, FunctionalState) {}
+void TIM_ITConfig(TIM_TypeDef *, uint16_t, FunctionalState) {}
+ITStatus TIM_GetITStatus(TIM_TypeDef *, uint16_t)
+{
+    return RESET;
+}
+void TIM_ClearITPendingBit(TIM_TypeDef *, uint16_t) {}
+void TIM_SetCounter(TIM_TypeDef *tim, uint16_t value)
+{
+    tim->CNT = value;
+}
+void TIM_SetAutoreload(TIM_TypeDef *tim, uint16_t value)
+{
+    tim->ATRLR = value;
+}
+void TIM_OC2PreloadConfig(TIM_TypeDef *, uint16_t) {}
+void TIM_OC3PreloadConfig(TIM_TypeDef *, uint16_t) {}
+void TIM_ClearFlag(TIM_TypeDef *, uint16_t) {}
+void RCC_APB1PeriphClockCmd(uint32_t, FunctionalState) {}
+void RCC_APB2PeriphClockCmd(uint32_t, FunctionalState) {}
+void RCC_AHBPeriphClockCmd(uint32_t, FunctionalState) {}
+void RCC_ADCCLKConfig(uint32_t) {}
+void WWDG_DeInit() {}
+void ADC_DeInit(ADC_TypeDef *) {}
+void ADC_Init(ADC_TypeDef *, ADC_InitTypeDef *) {}
+void ADC_Cmd(ADC_TypeDef *, FunctionalState) {}
+void ADC_BufferCmd(ADC_TypeDef *, FunctionalState) {}
+void ADC_ResetCalibration(ADC_TypeDef *) {}
+FlagStatus ADC_GetResetCalibrationStatus(ADC_TypeDef *)
+{
+    return RESET;
+}
+void ADC_StartCalibration(ADC_TypeDef *) {}
+FlagStatus ADC_GetCalibrationStatus(ADC_TypeDef *)
+{
+    return RESET;
+}
+int16_t Get_CalibrationValue(ADC_TypeDef *)
+{
+    return 0;
+}
+void ADC_RegularChannelConfig(ADC_TypeDef *, uint8_t, uint8_t, uint8_t) {}
+void ADC_DMACmd(ADC_TypeDef *, FunctionalState) {}
+void ADC_SoftwareStartConvCmd(ADC_TypeDef *, FunctionalState) {}
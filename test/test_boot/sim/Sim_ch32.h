@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Hooks into the simulated CH32 for the boot test
+ *
+ * The printer side of BambuBus: Sim_bus_receive() feeds a frame through the
+ * real USART1 RX interrupt handler, one byte time (1.25 Mbaud, 9 data bits
+ * with parity) apart on the simulated clock. Replies are not decoded; the
+ * sim only counts the DMA transfers the firmware starts on the TX channel.
+ */
+extern void Sim_bus_receive(const uint8_t *data, int length);
+extern uint32_t Sim_bus_tx_count();
+extern uint32_t Sim_bus_tx_length();
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Bitwise CRC with the interface of the robtillaart/CRC classes, which need
+ * the Arduino core; CRC8.h and CRC16.h instantiate it for BambuBus.cpp
+ */
+template <typename T>
+class Sim_crc
+{
+    static const int bits = sizeof(T) * 8;
+    T polynome = 0, initial = 0, xor_out = 0;
+    bool reverse_in = false, reverse_out = false;
+    T crc = 0;
+
+    static T reverse(T value, int count)
+    {
+        T result = 0;
+        for (int i = 0; i < count; i++)
+        {
+            result = (result << 1) | (value & 1);
+            value >>= 1;
+        }
+        return result;
+    }
+
+public:
+    Sim_crc() {}
+    Sim_crc(T _polynome, T _initial, T _xor_out, bool _reverse_in, bool _reverse_out)
+    {
+        reset(_polynome, _initial, _xor_out, _reverse_in, _reverse_out);
+    }
+    void reset(T _polynome, T _initial, T _xor_out, bool _reverse_in, bool _reverse_out)
+    {
+        polynome = _polynome;
+        initial = _initial;
+        xor_out = _xor_out;
+        reverse_in = _reverse_in;
+        reverse_out = _reverse_out;
+        restart();
+    }
+    void restart()
+    {
+        crc = initial;
+    }
+    void add(uint8_t value)
+    {
+        if (reverse_in)
+            value = (uint8_t)reverse(value, 8);
+        crc ^= (T)((T)value << (bits - 8));
+        for (int i = 0; i < 8; i++)
+            crc = (crc & ((T)1 << (bits - 1))) ? (T)((crc << 1) ^ polynome) : (T)(crc << 1);
+    }
+    void add(const uint8_t *data, uint16_t length)
+    {
+        while (length--)
+            add(*data++);
+    }
+    T calc()
+    {
+        return (T)((reverse_out ? reverse(crc, bits) : crc) ^ xor_out);
+    }
+};
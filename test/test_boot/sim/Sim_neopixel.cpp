@@ -0,0 +1,57 @@
+/*
+ * The parts of Adafruit_NeoPixel the firmware uses, without the per-arch
+ * bit-banged show(): on the target the strips are sent by WS2812_DMA.cpp.
+ * The library source itself has no host port and is left out of the sim.
+ */
+#include <Arduino.h>
+#include "Adafruit_NeoPixel.h"
+
+Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, int16_t p, neoPixelType t)
+    : begun(false), numLEDs(0), numBytes(0), pin(p), brightness(0), pixels(NULL), rOffset(1), gOffset(0),
+      bOffset(2), wOffset(1), endTime(0)
+{
+    updateType(t);
+    updateLength(n);
+}
+
+Adafruit_NeoPixel::~Adafruit_NeoPixel()
+{
+    free(pixels);
+}
+
+bool Adafruit_NeoPixel::begin(void)
+{
+    begun = pin >= 0;
+    return begun;
+}
+
+void Adafruit_NeoPixel::updateLength(uint16_t n)
+{
+    free(pixels);
+    numBytes = n * ((wOffset == rOffset) ? 3 : 4);
+    pixels = (uint8_t *)calloc(numBytes, 1);
+    numLEDs = pixels ? n : 0;
+}
+
+void Adafruit_NeoPixel::updateType(neoPixelType t)
+{
+    wOffset = (t >> 6) & 0b11;
+    rOffset = (t >> 4) & 0b11;
+    gOffset = (t >> 2) & 0b11;
+    bOffset = t & 0b11;
+#if defined(NEO_KHZ400)
+    is800KHz = (t < 256);
+#endif
+}
+
+void Adafruit_NeoPixel::setPixelColor(uint16_t n, uint32_t c)
+{
+    if (n >= numLEDs)
+        return;
+    uint8_t *p = &pixels[n * ((wOffset == rOffset) ? 3 : 4)];
+    if (wOffset != rOffset)
+        p[wOffset] = (uint8_t)(c >> 24);
+    p[rOffset] = (uint8_t)(c >> 16);
+    p[gOffset] = (uint8_t)(c >> 8);
+    p[bOffset] = (uint8_t)c;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+/*
+ * Host stand-in for the WCH SPL header, just enough for the firmware sources
+ * to build and run their boot path on a PC. Peripherals are plain structs in
+ * RAM and the SPL calls are no-ops (Sim_ch32.cpp); nothing here models
+ * timing except what Arduino.h's delay functions add to the simulated clock.
+ */
+#include <stdint.h>
+
+// The target's "WCH-Interrupt-fast" handlers become ordinary functions
+#define interrupt(x) used
+#define __IO volatile
+typedef enum {RESET=0, SET=!RESET} FlagStatus, ITStatus;
+typedef enum {DISABLE=0, ENABLE=!DISABLE} FunctionalState;
+typedef struct { __IO uint32_t CFGLR, CFGHR, INDR, OUTDR, BSHR, BCR, LCKR; } GPIO_TypeDef;
+typedef struct { __IO uint16_t STATR, r0, DATAR, r1, BRR, r2, CTLR1, r3, CTLR2, r4, CTLR3, r5, GPR, r6; } USART_TypeDef;
+typedef struct { __IO uint32_t CFGR, CNTR, PADDR, MADDR; } DMA_Channel_TypeDef;
+typedef struct { __IO uint32_t INTFR, INTFCR; } DMA_TypeDef;
+typedef struct { __IO uint16_t CTLR1,r0,CTLR2,r1,SMCFGR,r2,DMAINTENR,r3,INTFR,r4,SWEVGR,r5,CHCTLR1,r6,CHCTLR2,r7,CCER,r8,CNT,r9,PSC,r10,ATRLR,r11,RPTCR,r12,CH1CVR,r13,CH2CVR,r14,CH3CVR,r15,CH4CVR,r16,BDTR,r17,DMACFGR,r18,DMAADR,r19; } TIM_TypeDef;
+typedef struct { __IO uint32_t CTLR, SR; __IO uint64_t CNT, CMP; } SysTick_Type;
+typedef struct { __IO uint32_t RDATAR; } ADC_TypeDef;
+extern GPIO_TypeDef *GPIOA,*GPIOB,*GPIOC,*GPIOD; extern USART_TypeDef *USART1,*USART3; extern DMA_Channel_TypeDef *DMA1_Channel1,*DMA1_Channel2,*DMA1_Channel3,*DMA1_Channel4,*DMA1_Channel5,*DMA1_Channel6,*DMA1_Channel7; extern DMA_TypeDef *DMA1;
+extern TIM_TypeDef *TIM1,*TIM2,*TIM3,*TIM4; extern SysTick_Type *SysTick; extern ADC_TypeDef *ADC1; extern uint32_t SystemCoreClock;
+typedef struct { uint16_t GPIO_Pin; int GPIO_Speed; int GPIO_Mode; } GPIO_InitTypeDef;
+typedef struct { uint32_t USART_BaudRate; uint16_t USART_WordLength, USART_StopBits, USART_Parity, USART_Mode, USART_HardwareFlowControl; } USART_InitTypeDef;
+typedef struct { uint8_t NVIC_IRQChannel, NVIC_IRQChannelPreemptionPriority, NVIC_IRQChannelSubPriority; FunctionalState NVIC_IRQChannelCmd; } NVIC_InitTypeDef;
+typedef struct { uint32_t DMA_PeripheralBaseAddr, DMA_MemoryBaseAddr, DMA_DIR, DMA_BufferSize, DMA_PeripheralInc, DMA_MemoryInc, DMA_PeripheralDataSize, DMA_MemoryDataSize, DMA_Mode, DMA_Priority, DMA_M2M; } DMA_InitTypeDef;
+typedef struct { uint16_t TIM_Prescaler, TIM_CounterMode, TIM_Period, TIM_ClockDivision; uint8_t TIM_RepetitionCounter; } TIM_TimeBaseInitTypeDef;
+typedef struct { uint16_t TIM_OCMode, TIM_OutputState, TIM_OutputNState, TIM_Pulse, TIM_OCPolarity, TIM_OCNPolarity, TIM_OCIdleState, TIM_OCNIdleState; } TIM_OCInitTypeDef;
+typedef struct { uint32_t SYSCLK_Frequency, HCLK_Frequency, PCLK1_Frequency, PCLK2_Frequency, ADCCLK_Frequency; } RCC_ClocksTypeDef;
+typedef struct { int ADC_Mode; FunctionalState ADC_ScanConvMode, ADC_ContinuousConvMode; uint32_t ADC_ExternalTrigConv, ADC_DataAlign; uint8_t ADC_NbrOfChannel; } ADC_InitTypeDef;
+#define GPIO_Pin_0 1
+#define GPIO_Pin_1 2
+#define GPIO_Pin_2 4
+#define GPIO_Pin_3 8
+#define GPIO_Pin_4 16
+#define GPIO_Pin_5 32
+#define GPIO_Pin_6 64
+#define GPIO_Pin_7 128
+#define GPIO_Pin_8 256
+#define GPIO_Pin_9 512
+#define GPIO_Pin_10 1024
+#define GPIO_Pin_11 2048
+#define GPIO_Pin_12 4096
+#define GPIO_Pin_15 32768
+enum { GPIO_Speed_50MHz=3, GPIO_Mode_AF_PP, GPIO_Mode_IPU, GPIO_Mode_Out_PP, GPIO_Mode_AIN };
+enum { USART_WordLength_9b=1, USART_StopBits_1, USART_Parity_Even, USART_HardwareFlowControl_None, USART_Mode_Tx=4, USART_Mode_Rx=8 };
+enum { USART_IT_RXNE=1, USART_IT_TC, USART_IT_IDLE, USART_IT_ORE, USART_DMAReq_Tx, USART_FLAG_ORE, USART_FLAG_IDLE };
+enum { USART1_IRQn=1, USART3_IRQn, DMA1_Channel2_IRQn, DMA1_Channel6_IRQn, TIM1_UP_IRQn };
+enum { DMA_DIR_PeripheralDST=1, DMA_DIR_PeripheralSRC, DMA_Mode_Normal, DMA_Mode_Circular, DMA_PeripheralInc_Disable, DMA_MemoryInc_Enable, DMA_MemoryInc_Disable, DMA_Priority_Low, DMA_Priority_Medium, DMA_Priority_High, DMA_Priority_VeryHigh, DMA_M2M_Disable, DMA_MemoryDataSize_Byte, DMA_MemoryDataSize_HalfWord, DMA_PeripheralDataSize_Byte, DMA_PeripheralDataSize_HalfWord, DMA_PeripheralDataSize_Word, DMA_MemoryDataSize_Word, DMA_IT_TC, DMA_IT_TE };
+#define DMA1_IT_TC2 0x20
+#define DMA1_IT_TC6 0x200000
+#define DMA1_IT_GL6 0x100000
+#define DMA1_IT_GL2 0x10
+#define DMA1_IT_GL3 0x100
+#define DMA1_IT_GL5 0x10000
+#define DMA1_FLAG_TC2 0x20
+#define DMA_CFGR1_EN 1
+enum { TIM_CounterMode_Up=0, TIM_OCMode_Timing, TIM_OCMode_PWM1, TIM_OutputState_Enable, TIM_OutputState_Disable, TIM_OCPolarity_High, TIM_OCPreload_Disable, TIM_OCPreload_Enable };
+#define TIM_DMA_Update 0x100
+#define TIM_DMA_CC2 0x400
+#define TIM_DMA_CC3 0x800
+#define TIM_IT_Update 1
+#define TIM_FLAG_Update 1
+#define TIM_CTLR1_CEN 1
+enum { RCC_APB1Periph_USART3=1, RCC_APB2Periph_GPIOA, RCC_APB2Periph_GPIOB, RCC_APB2Periph_GPIOC, RCC_APB2Periph_GPIOD, RCC_AHBPeriph_DMA1, RCC_APB2Periph_USART1, RCC_APB1Periph_WWDG, RCC_APB2Periph_AFIO, RCC_APB1Periph_TIM2, RCC_APB1Periph_TIM3, RCC_APB1Periph_TIM4, RCC_APB2Periph_TIM1, RCC_APB2Periph_ADC1, RCC_PCLK2_Div8 };
+enum { GPIO_Remap_PD01=1, GPIO_FullRemap_TIM2, GPIO_PartialRemap_TIM3, GPIO_Remap_TIM4 };
+enum { ADC_Mode_Independent=0, ADC_ExternalTrigConv_None, ADC_DataAlign_Right, ADC_SampleTime_239Cycles5 };
+void GPIO_Init(GPIO_TypeDef*, GPIO_InitTypeDef*); void GPIO_PinRemapConfig(uint32_t, FunctionalState);
+void USART_Init(USART_TypeDef*, USART_InitTypeDef*); void USART_ITConfig(USART_TypeDef*, uint16_t, FunctionalState); void USART_Cmd(USART_TypeDef*, FunctionalState);
+ITStatus USART_GetITStatus(USART_TypeDef*, uint16_t); void USART_ClearITPendingBit(USART_TypeDef*, uint16_t); uint16_t USART_ReceiveData(USART_TypeDef*); void USART_DMACmd(USART_TypeDef*, uint16_t, FunctionalState); FlagStatus USART_GetFlagStatus(USART_TypeDef*, uint16_t);
+void NVIC_Init(NVIC_InitTypeDef*); void NVIC_EnableIRQ(int); void NVIC_DisableIRQ(int);
+void DMA_DeInit(DMA_Channel_TypeDef*); void DMA_Init(DMA_Channel_TypeDef*, DMA_InitTypeDef*); void DMA_Cmd(DMA_Channel_TypeDef*, FunctionalState); void DMA_ITConfig(DMA_Channel_TypeDef*, uint32_t, FunctionalState); ITStatus DMA_GetITStatus(uint32_t); void DMA_ClearITPendingBit(uint32_t); uint16_t DMA_GetCurrDataCounter(DMA_Channel_TypeDef*); void DMA_ClearFlag(uint32_t);
+void TIM_TimeBaseInit(TIM_TypeDef*, TIM_TimeBaseInitTypeDef*); void TIM_OC1Init(TIM_TypeDef*, TIM_OCInitTypeDef*); void TIM_OC2Init(TIM_TypeDef*, TIM_OCInitTypeDef*); void TIM_OC3Init(TIM_TypeDef*, TIM_OCInitTypeDef*); void TIM_OC4Init(TIM_TypeDef*, TIM_OCInitTypeDef*);
+void TIM_CtrlPWMOutputs(TIM_TypeDef*, FunctionalState); void TIM_ARRPreloadConfig(TIM_TypeDef*, FunctionalState); void TIM_Cmd(TIM_TypeDef*, FunctionalState); void TIM_SetCompare1(TIM_TypeDef*, uint16_t); void TIM_SetCompare2(TIM_TypeDef*, uint16_t); void TIM_SetCompare3(TIM_TypeDef*, uint16_t); void TIM_SetCompare4(TIM_TypeDef*, uint16_t);
+void TIM_DMACmd(TIM_TypeDef*, uint16_t, FunctionalState); void TIM_ITConfig(TIM_TypeDef*, uint16_t, FunctionalState); ITStatus TIM_GetITStatus(TIM_TypeDef*, uint16_t); void TIM_ClearITPendingBit(TIM_TypeDef*, uint16_t); void TIM_SetCounter(TIM_TypeDef*, uint16_t); void TIM_SetAutoreload(TIM_TypeDef*, uint16_t); void TIM_OC2PreloadConfig(TIM_TypeDef*, uint16_t); void TIM_OC3PreloadConfig(TIM_TypeDef*, uint16_t); void TIM_ClearFlag(TIM_TypeDef*, uint16_t);
+void RCC_APB1PeriphClockCmd(uint32_t, FunctionalState); void RCC_APB2PeriphClockCmd(uint32_t, FunctionalState); void RCC_AHBPeriphClockCmd(uint32_t, FunctionalState); void RCC_GetClocksFreq(RCC_ClocksTypeDef*); void RCC_ADCCLKConfig(uint32_t);
+void WWDG_DeInit();
+void ADC_DeInit(ADC_TypeDef*); void ADC_Init(ADC_TypeDef*, ADC_InitTypeDef*); void ADC_Cmd(ADC_TypeDef*, FunctionalState); void ADC_BufferCmd(ADC_TypeDef*, FunctionalState); void ADC_ResetCalibration(ADC_TypeDef*); FlagStatus ADC_GetResetCalibrationStatus(ADC_TypeDef*); void ADC_StartCalibration(ADC_TypeDef*); FlagStatus ADC_GetCalibrationStatus(ADC_TypeDef*); int16_t Get_CalibrationValue(ADC_TypeDef*); void ADC_RegularChannelConfig(ADC_TypeDef*, uint8_t, uint8_t, uint8_t); void ADC_DMACmd(ADC_TypeDef*, FunctionalState); void ADC_SoftwareStartConvCmd(ADC_TypeDef*, FunctionalState);
+void __disable_irq(); void __enable_irq(); void __WFI(); uint32_t __get_MSTATUS(); void __set_MSTATUS(uint32_t);
+typedef struct { __IO uint32_t CTLR, CFGR0, INTR, APB2PRSTR, APB1PRSTR, AHBPCENR, APB2PCENR, APB1PCENR, BDCTLR, RSTSCKR; } RCC_TypeDef;
+extern RCC_TypeDef *RCC;
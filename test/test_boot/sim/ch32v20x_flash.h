@@ -0,0 +1,9 @@
+#pragma once
+
+// Declarations only: the sim links Flash_sim.cpp instead of Flash_saves.cpp
+typedef enum { FLASH_BUSY=1, FLASH_ERROR_PG, FLASH_ERROR_WRP, FLASH_COMPLETE, FLASH_TIMEOUT } FLASH_Status;
+#define FLASH_FLAG_BSY 1
+#define FLASH_FLAG_EOP 0x20
+#define FLASH_FLAG_WRPRTERR 0x10
+#define FLASH_WRProt_Pages60to63 0
+void FLASH_Unlock(); void FLASH_Lock(); void FLASH_ClearFlag(uint32_t); FLASH_Status FLASH_ErasePage(uint32_t); FLASH_Status FLASH_ProgramHalfWord(uint32_t, uint16_t); FlagStatus FLASH_GetFlagStatus(uint32_t); FLASH_Status FLASH_GetStatus();
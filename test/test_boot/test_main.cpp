@@ -0,0 +1,164 @@
+/*
+ * Boot timing on a simulated CH32 (sim/): the whole firmware runs setup() and
+ * the scheduler with delay() and millis() on the simulated clock in Host.cpp,
+ * the printer asks for the AMS, and the first reply has to leave within
+ * BOOT_FIRST_REPLY_BUDGET_MS. A blocking wait added anywhere on that path
+ * fails test_real_boot_first_reply. The rest checks the Boot.cpp bookkeeping.
+ *
+ *   pio test -e native_boot
+ */
+#include <unity.h>
+#include "Boot.h"
+#include "Host.h"
+#include "Flash_sim.h"
+#include "Sim_ch32.h"
+#include "CRC8.h"
+#include "CRC16.h"
+
+extern uint32_t Boot_reached_mask;
+extern bool Boot_reported;
+// From main.cpp and Scheduler.h, whose headers clash with Host.h
+extern void setup();
+extern bool Sched_run();
+extern void Sched_idle();
+
+// The first thing a printer sends: a short online_detect frame for registration
+static void test_send_online_detect()
+{
+    uint8_t frame[8] = {0x3D, 0xC5, sizeof(frame), 0, 0x05, 0x00};
+    CRC8 crc_8(0x39, 0x66, 0, false, false);
+    crc_8.add(frame, 3);
+    frame[3] = crc_8.calc();
+    CRC16 crc_16(0x1021, 0x913D, 0, false, false);
+    crc_16.add(frame, sizeof(frame) - 2);
+    uint16_t crc = crc_16.calc();
+    frame[6] = crc & 0xFF;
+    frame[7] = crc >> 8;
+    Sim_bus_receive(frame, sizeof(frame));
+}
+
+// The body of loop(), which never returns, until phase is reached
+static void test_loop_until(Boot_phase phase, uint32_t timeout_us)
+{
+    while (!Boot_reached(phase) && (micros() < timeout_us))
+    {
+        if (!Sched_run())
+            Sched_idle();
+    }
+}
+
+static void test_mark_at(Boot_phase phase, uint32_t time_us)
+{
+    Host_set_time_us(time_us);
+    Boot_mark(phase);
+}
+
+// setup() phases in order, each taking phase_us
+static void test_setup(uint32_t phase_us)
+{
+    for (int phase = BOOT_SETUP_ENTRY; phase <= BOOT_SETUP_DONE; phase++)
+        test_mark_at((Boot_phase)phase, phase * phase_us);
+}
+
+void setUp()
+{
+    Boot_reached_mask = 0;
+    Boot_reported = false;
+    Host_set_time_us(0);
+}
+
+void tearDown()
+{
+}
+
+// Runs once, on blank flash; the background phases finish after the reply
+void test_real_boot_first_reply()
+{
+    Flash_sim_erase_all();
+    setup();
+    TEST_ASSERT_TRUE(Boot_reached(BOOT_SETUP_DONE));
+    test_send_online_detect();
+    test_loop_until(BOOT_FIRST_REPLY, BOOT_REPORT_TIMEOUT_MS * 1000UL);
+    TEST_ASSERT_TRUE(Boot_reached(BOOT_FIRST_REPLY));
+    TEST_ASSERT_EQUAL_UINT32(1, Sim_bus_tx_count());
+    TEST_ASSERT_EQUAL_UINT32(29, Sim_bus_tx_length());
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(BOOT_FIRST_REPLY_BUDGET_MS * 1000UL, Boot_time_us(BOOT_FIRST_REPLY));
+    TEST_ASSERT_FALSE(Boot_first_reply_late());
+
+    test_loop_until(BOOT_ADC_READY, BOOT_REPORT_TIMEOUT_MS * 1000UL);
+    test_loop_until(BOOT_DIR_PROBE_DONE, BOOT_REPORT_TIMEOUT_MS * 1000UL);
+    TEST_ASSERT_TRUE(Boot_reached(BOOT_ADC_READY));
+    TEST_ASSERT_TRUE(Boot_reached(BOOT_DIR_PROBE_DONE));
+    Boot_run();
+    TEST_ASSERT_TRUE(Boot_reported);
+}
+
+void test_mark_keeps_first_time()
+{
+    test_mark_at(BOOT_ADC_READY, 1000);
+    test_mark_at(BOOT_ADC_READY, 5000);
+    TEST_ASSERT_TRUE(Boot_reached(BOOT_ADC_READY));
+    TEST_ASSERT_EQUAL_UINT32(1000, Boot_time_us(BOOT_ADC_READY));
+    TEST_ASSERT_FALSE(Boot_reached(BOOT_DIR_PROBE_DONE));
+}
+
+void test_first_reply_within_budget()
+{
+    test_setup(5000);
+    test_mark_at(BOOT_FIRST_REPLY, BOOT_FIRST_REPLY_BUDGET_MS * 1000UL);
+    Host_set_time_us(BOOT_REPORT_TIMEOUT_MS * 1000UL);
+    TEST_ASSERT_FALSE(Boot_first_reply_late());
+}
+
+void test_first_reply_over_budget()
+{
+    test_setup(5000);
+    test_mark_at(BOOT_FIRST_REPLY, BOOT_FIRST_REPLY_BUDGET_MS * 1000UL + 1);
+    TEST_ASSERT_TRUE(Boot_first_reply_late());
+}
+
+void test_missing_reply_is_late_once_budget_passed()
+{
+    test_setup(5000);
+    Host_set_time_us(BOOT_FIRST_REPLY_BUDGET_MS * 1000UL);
+    TEST_ASSERT_FALSE(Boot_first_reply_late());
+    Host_set_time_us(BOOT_FIRST_REPLY_BUDGET_MS * 1000UL + 1);
+    TEST_ASSERT_TRUE(Boot_first_reply_late());
+}
+
+void test_report_waits_for_all_phases()
+{
+    test_setup(5000);
+    test_mark_at(BOOT_FIRST_REPLY, 60000);
+    Boot_run();
+    TEST_ASSERT_FALSE(Boot_reported);
+    test_mark_at(BOOT_ADC_READY, 70000);
+    test_mark_at(BOOT_DIR_PROBE_DONE, 80000);
+    Boot_run();
+    TEST_ASSERT_TRUE(Boot_reported);
+}
+
+void test_report_after_timeout()
+{
+    test_setup(5000);
+    Host_set_time_us(BOOT_REPORT_TIMEOUT_MS * 1000UL - 1000);
+    Boot_run();
+    TEST_ASSERT_FALSE(Boot_reported);
+    Host_set_time_us(BOOT_REPORT_TIMEOUT_MS * 1000UL);
+    Boot_run();
+    TEST_ASSERT_TRUE(Boot_reported);
+    TEST_ASSERT_TRUE(Boot_first_reply_late());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_real_boot_first_reply);
+    RUN_TEST(test_mark_keeps_first_time);
+    RUN_TEST(test_first_reply_within_budget);
+    RUN_TEST(test_first_reply_over_budget);
+    RUN_TEST(test_missing_reply_is_late_once_budget_passed);
+    RUN_TEST(test_report_waits_for_all_phases);
+    RUN_TEST(test_report_after_timeout);
+    return UNITY_END();
+}
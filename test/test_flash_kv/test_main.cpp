@@ -0,0 +1,247 @@
+/*
+ * Flash_kv on simulated flash: normal operation, compaction, and power cuts
+ * at random erase/program operations. After every cut the log is re-opened
+ * as on a reboot; each key must read back its last committed value, or the
+ * value that was being written when power went.
+ *
+ *   pio test -e native
+ */
+#include <unity.h>
+#include <vector>
+#include "Flash_kv.h"
+#include "Flash_sim.h"
+
+#define TEST_KEYS 6
+#define FUZZ_WRITES 400
+
+static const uint8_t test_keys[TEST_KEYS] = {FLASH_KV_KEY_MOTION_DIR, FLASH_KV_KEY_BUS_STATE, FLASH_KV_KEY_TUNING,
+                                             FLASH_KV_KEY_FILAMENT, FLASH_KV_KEY_FILAMENT + 1, FLASH_KV_KEY_FILAMENT + 3};
+
+struct Test_value
+{
+    bool present = false;
+    uint8_t version = 0;
+    std::vector<uint8_t> data;
+
+    bool operator==(const Test_value &other) const
+    {
+        return (present == other.present) && (!present || ((version == other.version) && (data == other.data)));
+    }
+};
+
+static uint32_t test_random = 12345;
+
+static uint32_t test_next()
+{
+    test_random ^= test_random << 13;
+    test_random ^= test_random >> 17;
+    test_random ^= test_random << 5;
+    return test_random;
+}
+
+static Test_value test_stored(uint8_t key)
+{
+    Test_value value;
+    uint16_t length;
+    const uint8_t *data = (const uint8_t *)Flash_kv_find(key, &value.version, &length);
+    if (data)
+    {
+        value.present = true;
+        value.data.assign(data, data + length);
+    }
+    return value;
+}
+
+static Test_value test_random_value()
+{
+    Test_value value;
+    value.present = true;
+    value.version = test_next() % 3;
+    value.data.resize(1 + test_next() % FLASH_KV_MAX_VALUE);
+    for (uint8_t &byte : value.data)
+        byte = test_next();
+    return value;
+}
+
+// Run the writer until the queue drains; throws Flash_sim_power_loss if power is cut
+static void test_flush()
+{
+    for (int step = 0; Flash_kv_busy(); step++)
+    {
+        TEST_ASSERT_LESS_THAN(100000, step);
+        Flash_kv_run(true);
+    }
+}
+
+void setUp()
+{
+    Flash_sim_erase_all();
+    Flash_kv_init();
+}
+
+void tearDown()
+{
+}
+
+void test_blank_log_is_empty()
+{
+    for (uint8_t key : test_keys)
+        TEST_ASSERT_FALSE(test_stored(key).present);
+}
+
+void test_write_read_back()
+{
+    uint8_t data[4] = {1, 2, 3, 4};
+    TEST_ASSERT_TRUE(Flash_kv_write(FLASH_KV_KEY_TUNING, 7, data, sizeof(data)));
+    test_flush();
+
+    uint8_t read[4] = {};
+    TEST_ASSERT_TRUE(Flash_kv_read(FLASH_KV_KEY_TUNING, 7, read, sizeof(read)));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(data, read, sizeof(data));
+    TEST_ASSERT_FALSE(Flash_kv_read(FLASH_KV_KEY_TUNING, 8, read, sizeof(read))); // version mismatch
+    TEST_ASSERT_FALSE(Flash_kv_read(FLASH_KV_KEY_TUNING, 7, read, 3));             // length mismatch
+
+    Flash_kv_init(); // reboot
+    TEST_ASSERT_TRUE(Flash_kv_read(FLASH_KV_KEY_TUNING, 7, read, sizeof(read)));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(data, read, sizeof(data));
+}
+
+void test_unchanged_value_not_written()
+{
+    uint8_t data[8] = {9, 9, 9, 9, 9, 9, 9, 9};
+    Flash_kv_write(FLASH_KV_KEY_BUS_STATE, 1, data, sizeof(data));
+    test_flush();
+    uint32_t operations = Flash_sim_operations();
+    Flash_kv_write(FLASH_KV_KEY_BUS_STATE, 1, data, sizeof(data));
+    test_flush();
+    TEST_ASSERT_EQUAL_UINT32(operations, Flash_sim_operations());
+}
+
+// Every key in use can be waiting at once, even behind a write in progress
+void test_queue_holds_every_key()
+{
+    uint8_t data[FLASH_KV_MAX_VALUE] = {1};
+    TEST_ASSERT_TRUE(Flash_kv_write(FLASH_KV_KEY_MOTION_DIR, 1, data, sizeof(data)));
+    Flash_kv_run(true); // the head job now owns its slot
+    for (int key = FLASH_KV_KEY_MOTION_DIR; key <= FLASH_KV_KEY_PRESSURE_GAINS; key++)
+        TEST_ASSERT_TRUE(Flash_kv_write(key, 2, data, sizeof(data)));
+    for (int i = 0; i < MAX_FILAMENT_CHANNELS; i++)
+        TEST_ASSERT_TRUE(Flash_kv_write(FLASH_KV_KEY_FILAMENT + i, 2, data, sizeof(data)));
+    test_flush();
+
+    uint8_t read[FLASH_KV_MAX_VALUE];
+    for (int key = FLASH_KV_KEY_MOTION_DIR; key <= FLASH_KV_KEY_PRESSURE_GAINS; key++)
+        TEST_ASSERT_TRUE(Flash_kv_read(key, 2, read, sizeof(read)));
+    for (int i = 0; i < MAX_FILAMENT_CHANNELS; i++)
+        TEST_ASSERT_TRUE(Flash_kv_read(FLASH_KV_KEY_FILAMENT + i, 2, read, sizeof(read)));
+}
+
+// Enough writes to go through several compactions; every key keeps its latest value
+void test_compaction_keeps_latest()
+{
+    Test_value model[TEST_KEYS];
+    for (int i = 0; i < 500; i++)
+    {
+        int k = test_next() % TEST_KEYS;
+        model[k] = test_random_value();
+        TEST_ASSERT_TRUE(Flash_kv_write(test_keys[k], model[k].version, model[k].data.data(), model[k].data.size()));
+        test_flush();
+    }
+    Flash_kv_init();
+    for (int k = 0; k < TEST_KEYS; k++)
+        TEST_ASSERT_TRUE(test_stored(test_keys[k]) == model[k]);
+}
+
+struct Test_write
+{
+    int k;
+    Test_value value;
+};
+
+// A random write sequence long enough to compact the log a few times
+static std::vector<Test_write> test_trace()
+{
+    std::vector<Test_write> trace(FUZZ_WRITES);
+    for (Test_write &write : trace)
+    {
+        write.k = test_next() % TEST_KEYS;
+        write.value = test_random_value();
+    }
+    return trace;
+}
+
+static void test_write(const Test_write &write)
+{
+    TEST_ASSERT_TRUE(Flash_kv_write(test_keys[write.k], write.value.version, write.value.data.data(),
+                                    write.value.data.size()));
+}
+
+/*
+ * Replay the same trace once per erase/program operation it performs and
+ * cut power at that operation, with random bits of the interrupted
+ * half-word or page getting through. After the reboot every key must hold
+ * its last committed value (the interrupted key may also hold the new one),
+ * and the log must still accept writes.
+ */
+void test_power_loss_fuzz()
+{
+    std::vector<Test_write> trace = test_trace();
+    uint32_t start = Flash_sim_operations();
+    for (const Test_write &write : trace)
+    {
+        test_write(write);
+        test_flush();
+    }
+    uint32_t total = Flash_sim_operations() - start;
+    TEST_ASSERT_GREATER_THAN(FUZZ_WRITES, total);
+
+    for (uint32_t cut = 1; cut <= total; cut++)
+    {
+        Flash_sim_erase_all();
+        Flash_kv_init();
+        Test_value committed[TEST_KEYS];
+        const Test_write *interrupted = NULL;
+        Flash_sim_cut_after(cut, test_next());
+        try
+        {
+            for (const Test_write &write : trace)
+            {
+                interrupted = &write;
+                test_write(write);
+                test_flush();
+                committed[write.k] = write.value;
+            }
+            interrupted = NULL;
+        }
+        catch (Flash_sim_power_loss &)
+        {
+        }
+        TEST_ASSERT_NOT_NULL_MESSAGE(interrupted, "power cut did not happen");
+
+        Flash_kv_init(); // reboot
+        for (int k = 0; k < TEST_KEYS; k++)
+        {
+            Test_value stored = test_stored(test_keys[k]);
+            bool ok = (stored == committed[k]) || ((k == interrupted->k) && (stored == interrupted->value));
+            TEST_ASSERT_TRUE_MESSAGE(ok, "recovered value is neither the committed nor the interrupted one");
+        }
+
+        Test_write after = {(int)(cut % TEST_KEYS), test_random_value()};
+        test_write(after);
+        test_flush();
+        Flash_kv_init();
+        TEST_ASSERT_TRUE_MESSAGE(test_stored(test_keys[after.k]) == after.value, "log not writable after recovery");
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_blank_log_is_empty);
+    RUN_TEST(test_write_read_back);
+    RUN_TEST(test_unchanged_value_not_written);
+    RUN_TEST(test_queue_holds_every_key);
+    RUN_TEST(test_compaction_keeps_latest);
+    RUN_TEST(test_power_loss_fuzz);
+    return UNITY_END();
+}
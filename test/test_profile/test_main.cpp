@@ -0,0 +1,122 @@
+/*
+ * Profiler statistics and dump format, timed by the simulated clock in
+ * Host.cpp so every sample is exact.
+ *
+ *   pio test -e native
+ */
+#include <unity.h>
+#include "Profile.h"
+#include "Host.h"
+
+#if !PROFILE_ENABLED
+#error "test_profile needs PROFILE_ENABLED (set by [env:native])"
+#endif
+
+static void test_advance(uint32_t time_us)
+{
+    Host_set_time_us(micros() + time_us);
+}
+
+// One PROFILE_SCOPE region that takes time_us
+static void test_region(uint32_t time_us)
+{
+    PROFILE_SCOPE(BUS_RUN);
+    test_advance(time_us);
+}
+
+void setUp()
+{
+    Profile_reset();
+    Host_output_clear();
+    Host_set_time_us(1000);
+}
+
+void tearDown()
+{
+}
+
+void test_scope_times_the_block()
+{
+    test_region(250);
+    const Profile_stat *stat = Profile_get(PROFILE_BUS_RUN);
+    TEST_ASSERT_EQUAL_UINT32(1, stat->count);
+    TEST_ASSERT_EQUAL_UINT32(250, stat->min_us);
+    TEST_ASSERT_EQUAL_UINT32(250, stat->max_us);
+    TEST_ASSERT_EQUAL_UINT32(250, (uint32_t)stat->total_us);
+    TEST_ASSERT_EQUAL_UINT32(0, Profile_get(PROFILE_LOOP)->count);
+}
+
+void test_min_max_total()
+{
+    test_region(300);
+    test_region(100);
+    test_region(200);
+    const Profile_stat *stat = Profile_get(PROFILE_BUS_RUN);
+    TEST_ASSERT_EQUAL_UINT32(3, stat->count);
+    TEST_ASSERT_EQUAL_UINT32(100, stat->min_us);
+    TEST_ASSERT_EQUAL_UINT32(300, stat->max_us);
+    TEST_ASSERT_EQUAL_UINT32(600, (uint32_t)stat->total_us);
+}
+
+void test_zero_length_sample_is_the_min()
+{
+    test_region(50);
+    test_region(0);
+    TEST_ASSERT_EQUAL_UINT32(0, Profile_get(PROFILE_BUS_RUN)->min_us);
+    TEST_ASSERT_EQUAL_UINT32(2, Profile_get(PROFILE_BUS_RUN)->count);
+}
+
+void test_nested_scopes()
+{
+    {
+        PROFILE_SCOPE(LOOP);
+        test_advance(100);
+        test_region(300);
+        test_advance(600);
+    }
+    TEST_ASSERT_EQUAL_UINT32(1000, (uint32_t)Profile_get(PROFILE_LOOP)->total_us);
+    TEST_ASSERT_EQUAL_UINT32(300, (uint32_t)Profile_get(PROFILE_BUS_RUN)->total_us);
+}
+
+void test_reset_clears()
+{
+    test_region(100);
+    Profile_reset();
+    const Profile_stat *stat = Profile_get(PROFILE_BUS_RUN);
+    TEST_ASSERT_EQUAL_UINT32(0, stat->count);
+    TEST_ASSERT_EQUAL_UINT32(0, stat->max_us);
+    TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)stat->total_us);
+}
+
+void test_dump_lines()
+{
+    {
+        PROFILE_SCOPE(LOOP);
+        test_region(100);
+        test_region(300);
+        test_advance(600);
+    }
+    Profile_dump();
+    const char *out = Host_output();
+    TEST_ASSERT_NOT_NULL(strstr(out, "OK profile slot count min_us mean_us max_us total_us share_permille\n"));
+    TEST_ASSERT_NOT_NULL(strstr(out, "OK LOOP 1 1000 1000 1000 1000 1000\n"));
+    TEST_ASSERT_NOT_NULL(strstr(out, "OK BUS_RUN 2 100 200 300 400 400\n"));
+    TEST_ASSERT_NOT_NULL(strstr(out, "OK FLASH_RUN 0 0 0 0 0 0\n"));
+    // One header plus one line per slot
+    int lines = 0;
+    for (const char *c = out; *c; c++)
+        lines += (*c == '\n');
+    TEST_ASSERT_EQUAL_INT(1 + PROFILE_SLOT_COUNT, lines);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_scope_times_the_block);
+    RUN_TEST(test_min_max_total);
+    RUN_TEST(test_zero_length_sample_is_the_min);
+    RUN_TEST(test_nested_scopes);
+    RUN_TEST(test_reset_clears);
+    RUN_TEST(test_dump_lines);
+    return UNITY_END();
+}